@@ -0,0 +1,222 @@
+#ifndef GTKMM_EXAMPLE_ARENA_H
+#define GTKMM_EXAMPLE_ARENA_H
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+
+/**
+   Bump allocator for the scratch data of one simulation step (lists
+   of neighbors, velocity changes, etc.), so that a step doesn't call
+   the global allocator once the arena has grown to the size the step
+   needs.
+
+   Use as follows:
+
+   real *dv = arena.allocate<real>(n);
+   ...
+   arena.reset();
+
+   allocate() only moves a pointer forward. When the current block is
+   full, the next block is used, and a new one is allocated if there
+   is none; that is the only time the arena allocates memory.
+   reset() frees all allocations at once and, if more than one block
+   was in use, replaces the blocks by a single one as large as all of
+   them together. Mark and rewind() free the allocations made after
+   the mark, for scratch data that is only needed for a while within
+   a step.
+
+   Only trivial types can be allocated, since no constructors or
+   destructors are run.
+ */
+class Arena
+{
+public:
+  enum : std::size_t { default_block_size = 64u << 10 };
+
+  /**
+     A position in the arena to rewind() to.
+   */
+  struct Mark
+  {
+    std::size_t block;
+    std::size_t offset;
+  };
+
+  explicit Arena(std::size_t block_size = default_block_size)
+    : block_size_(std::max<std::size_t>(block_size,64)),
+      blocks_(),
+      block_(0),
+      offset_(0),
+      allocations_(0)
+  { }
+
+  Arena(Arena &&) = default;
+  Arena &operator=(Arena &&) = default;
+
+  /**
+     Uninitialized space for n objects of type T.
+   */
+  template <class T>
+  T *allocate(std::size_t n)
+  {
+    static_assert(std::is_trivial<T>::value,"the arena only holds trivial types");
+    return static_cast<T*>(allocate(n * sizeof(T),alignof(T)));
+  }
+
+  void *allocate(std::size_t bytes, std::size_t align)
+  {
+    while (block_ < blocks_.size())
+      {
+        const Block &block = blocks_[block_];
+        const std::uintptr_t base  = reinterpret_cast<std::uintptr_t>(block.data.get());
+        const std::uintptr_t start = (base + offset_ + align - 1) & ~std::uintptr_t(align - 1);
+        if (start + bytes <= base + block.size)
+          {
+            offset_ = start + bytes - base;
+            return reinterpret_cast<void*>(start);
+          }
+        ++block_;
+        offset_ = 0;
+      }
+
+    const std::size_t last = (blocks_.empty() ? block_size_ : blocks_.back().size);
+    add_block(std::max(2 * last,bytes + align));
+    return allocate(bytes,align);
+  }
+
+  Mark mark() const
+  { return { block_, offset_ }; }
+
+  /**
+     Free everything allocated since the mark was taken.
+   */
+  void rewind(Mark mark)
+  {
+    block_  = mark.block;
+    offset_ = mark.offset;
+  }
+
+  /**
+     Free everything, and merge the blocks into one if the arena had
+     to grow, so that the next step of the same size fits into it.
+   */
+  void reset()
+  {
+    if (blocks_.size() > 1)
+      {
+        std::size_t total = 0;
+        for (const Block &block : blocks_)
+          total += block.size;
+        blocks_.clear();
+        add_block(total);
+      }
+    block_  = 0;
+    offset_ = 0;
+  }
+
+  /**
+     Bytes held by the arena.
+   */
+  std::size_t capacity() const
+  {
+    std::size_t total = 0;
+    for (const Block &block : blocks_)
+      total += block.size;
+    return total;
+  }
+
+  /**
+     Number of blocks allocated so far, e.g. to see whether the arena
+     is still growing.
+   */
+  unsigned long allocations() const
+  { return allocations_; }
+
+private:
+  struct Block
+  {
+    std::unique_ptr<unsigned char[]> data;
+    std::size_t                      size;
+  };
+
+  void add_block(std::size_t size)
+  {
+    blocks_.push_back({ std::unique_ptr<unsigned char[]>(new unsigned char[size]), size });
+    ++allocations_;
+  }
+
+  std::size_t        block_size_;
+  std::vector<Block> blocks_;
+  std::size_t        block_;
+  std::size_t        offset_;
+  unsigned long      allocations_;
+};
+
+/**
+   A growing array of trivial objects in an Arena, for lists whose
+   length isn't known in advance. When it is full, it moves to a space
+   twice as large further up in the arena; the old space is only
+   reclaimed by a rewind() or reset() of the arena.
+ */
+template <class T>
+class ArenaVector
+{
+public:
+  explicit ArenaVector(Arena &arena, std::size_t capacity = 16)
+    : arena_(arena),
+      data_(arena.allocate<T>(std::max<std::size_t>(capacity,1))),
+      size_(0),
+      capacity_(std::max<std::size_t>(capacity,1))
+  { }
+
+  void push_back(const T &value)
+  {
+    if (size_ == capacity_)
+      {
+        T *data = arena_.allocate<T>(2 * capacity_);
+        std::copy(data_,data_ + size_,data);
+        data_      = data;
+        capacity_ *= 2;
+      }
+    data_[size_++] = value;
+  }
+
+  void clear()
+  { size_ = 0; }
+
+  std::size_t size() const
+  { return size_; }
+
+  bool empty() const
+  { return size_ == 0; }
+
+  T &operator[](std::size_t i)
+  { return data_[i]; }
+
+  const T &operator[](std::size_t i) const
+  { return data_[i]; }
+
+  T *begin()
+  { return data_; }
+
+  T *end()
+  { return data_ + size_; }
+
+  const T *begin() const
+  { return data_; }
+
+  const T *end() const
+  { return data_ + size_; }
+
+private:
+  Arena      &arena_;
+  T          *data_;
+  std::size_t size_;
+  std::size_t capacity_;
+};
+
+#endif // GTKMM_EXAMPLE_ARENA_H
@@ -1,6 +1,9 @@
 #include <cairomm/context.h>
 #include <glibmm/main.h>
 #include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <cassert>
 
 #include "balls.h"
 
@@ -11,26 +14,195 @@ bool Balls::on_draw(const Cairo::RefPtr<Cairo::Context>& cr)
   const int width = allocation.get_width();
   const int height = allocation.get_height();
 
-  cr->save();
-  cr->scale(width, height);
+  if (!snapshot_)
+    snapshot_ = &physics_.latest();
 
-  cr->set_line_width(0.001);
-  for (auto ball : balls_)
+  const bool       replay   = replay_.active();
+  const Snapshot  &snapshot = *snapshot_;
+  const Particles &balls    = (replay ? replay_.balls() : snapshot.balls);
+  {
+    SIMUL_PROFILE_SCOPE(profiler_,Profiler::draw);
+    renderer_.draw(cr,balls,width,height);
+  }
+  SIMUL_PROFILE_ONLY(profiler_.end_step();)
+
+  std::ostringstream info;
+  if (replay)
+    info << "frame " << replay_.frame() + 1 << '/' << replay_.frames()
+         << "\nstep " << replay_.step()
+         << "\nspeed " << replay_.speed() << "/s"
+         << (replay_.paused() ? "\npaused" : "");
+  else if (balls.size() > 0)
     {
-      cr->set_source_rgb(ball.color_r,ball.color_g,ball.color_b);
-      cr->arc(ball.p.x,ball.p.y,
-              ball.rad,
-              0,2*M_PI);
-      cr->fill();
-      cr->stroke();
+      /* The big ball, which is added last. */
+      const auto ball1 = balls.view(std::min(balls.index_of(balls.size()-1),balls.size()-1));
+      info << "x = " << ball1.p().x << "\ny = " << ball1.p().y;
+      if (sim_.approximate())
+        info << "\ngrav err = " << snapshot.gravity_error;
     }
 
-  cr->restore();
+  SIMUL_PROFILE_ONLY(
+    /* The physics phases come from the physics thread, drawing from
+       this one. */
+    Profiler::Summary profile = snapshot.profile;
+    profile.phase[Profiler::draw] = profiler_.stats(Profiler::draw);
 
-  const Ball &ball1 = balls_[balls_.size()-1];
-  std::ostringstream info;
-  info << "x = " << ball1.p.x << "\ny = " << ball1.p.y;
+    info << std::fixed << std::setprecision(1)
+         << "\n" << std::setw(11) << "" << std::setw(10) << "mean" << std::setw(10) << "p99";
+    for (std::size_t p = 0 ; p < Profiler::phases ; ++p)
+      info << "\n" << std::left << std::setw(11) << Profiler::name(Profiler::Phase(p))
+           << std::right << std::setw(10) << profile.phase[p].mean
+           << std::setw(10) << profile.phase[p].p99 << "us";
+    info << std::setprecision(0);
+    for (std::size_t c = 0 ; c < Profiler::counters ; ++c)
+      info << "\n" << std::left << std::setw(11) << Profiler::name(Profiler::Counter(c))
+           << std::right << std::setw(10) << profile.counter[c].mean
+           << std::setw(10) << profile.counter[c].p99;
+  )
   infobox_.show(cr,width,height,info.str());
 
   return true;
 }
+
+namespace {
+
+/* The pixels ball i may touch when drawn, with a margin for the
+   anti-aliasing and for rounding to whole pixels. */
+Cairo::RectangleInt pixel_box(const Particles &balls, std::size_t i, int width, int height)
+{
+  const double r  = balls.rad[i];
+  const int    x0 = static_cast<int>(std::floor((balls.x[i] - r) * width)) - 2;
+  const int    y0 = static_cast<int>(std::floor((balls.y[i] - r) * height)) - 2;
+  const int    x1 = static_cast<int>(std::ceil((balls.x[i] + r) * width)) + 2;
+  const int    y1 = static_cast<int>(std::ceil((balls.y[i] + r) * height)) + 2;
+  return { x0, y0, x1 - x0, y1 - y0 };
+}
+
+bool operator!=(const Cairo::RectangleInt &a, const Cairo::RectangleInt &b)
+{
+  return (a.x != b.x || a.y != b.y || a.width != b.width || a.height != b.height);
+}
+
+} // namespace
+
+/**
+   Take the newest state and invalidate the union of the old and the
+   new areas of the balls that moved, plus the infobox if the state is
+   a new one. A state in which nothing moved costs no redraw at all.
+ */
+void Balls::invalidate_changes()
+{
+  Glib::RefPtr<Gdk::Window> win = get_window();
+  if (!win)
+    return;
+
+  Gtk::Allocation allocation = get_allocation();
+  const int width = allocation.get_width();
+  const int height = allocation.get_height();
+
+  snapshot_ = &physics_.latest();
+  const bool           replay = replay_.active();
+  const Particles     &balls  = (replay ? replay_.balls() : snapshot_->balls);
+  const unsigned long  frame  = (replay ? replay_.frame() : snapshot_->steps);
+  const std::size_t    n      = balls.size();
+
+  /* The boxes are kept by the ids of the balls, which don't change
+     when the simulation reorders them, in slots that cover all ids,
+     so that no two balls share one even when the ids have gaps. When
+     the balls or their ids change, everything is redrawn. */
+  std::size_t ids = 0;
+  for (std::size_t i = 0 ; i < n ; ++i)
+    ids = std::max(ids,balls.cold[i].id + 1);
+  bool full = (n != drawn_balls_ || ids != drawn_.size()
+               || width != drawn_width_ || height != drawn_height_);
+  drawn_.resize(ids);
+  drawn_balls_  = n;
+  drawn_width_  = width;
+  drawn_height_ = height;
+
+  auto region = Cairo::Region::create();
+  std::size_t dirty = 0;
+  for (std::size_t i = 0 ; i < n ; ++i)
+    {
+      const Cairo::RectangleInt box = pixel_box(balls,i,width,height);
+      assert(balls.cold[i].id < drawn_.size());
+      Cairo::RectangleInt &drawn = drawn_[balls.cold[i].id];
+      if (!full && box != drawn)
+        {
+          if (++dirty > max_dirty_balls)
+            full = true;
+          else
+            {
+              region->do_union(drawn);
+              region->do_union(box);
+            }
+        }
+      drawn = box;
+    }
+
+  if (full)
+    {
+      Gdk::Rectangle r(0,0,width,height);
+      win->invalidate_rect(r, false);
+    }
+  else if (dirty > 0 || frame != drawn_frame_)
+    {
+      region->do_union(infobox_.area(width,height));
+      win->invalidate_region(region, false);
+    }
+  drawn_frame_ = frame;
+}
+
+bool Balls::on_key_press_event(GdkEventKey *event)
+{
+  using Method = Renderer::Method;
+
+  if (event->keyval == GDK_KEY_r)
+    {
+      switch (renderer_.method())
+        {
+        case Method::per_ball: renderer_.method(Method::batched);  break;
+        case Method::batched:  renderer_.method(Method::sprites);  break;
+        case Method::sprites:  renderer_.method(Method::raster);   break;
+        case Method::raster:   renderer_.method(Method::per_ball); break;
+        }
+      queue_draw();
+      return true;
+    }
+
+  if (!replay_.active())
+    return false;
+
+  /* Seek by a second of playback, or by one frame when paused. */
+  const double skip = (replay_.paused() ? 1.0 : std::abs(replay_.speed()));
+  switch (event->keyval)
+    {
+    case GDK_KEY_space:
+      replay_.pause(!replay_.paused());
+      break;
+    case GDK_KEY_Left:
+      replay_.seek(replay_.frame() - skip);
+      break;
+    case GDK_KEY_Right:
+      replay_.seek(replay_.frame() + skip);
+      break;
+    case GDK_KEY_Home:
+      replay_.seek(0);
+      break;
+    case GDK_KEY_End:
+      replay_.seek(replay_.frames());
+      break;
+    case GDK_KEY_plus:
+    case GDK_KEY_KP_Add:
+      replay_.speed(replay_.speed() * 2);
+      break;
+    case GDK_KEY_minus:
+    case GDK_KEY_KP_Subtract:
+      replay_.speed(replay_.speed() / 2);
+      break;
+    default:
+      return false;
+    }
+  queue_draw();
+  return true;
+}
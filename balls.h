@@ -1,245 +1,173 @@
 #ifndef GTKMM_EXAMPLE_BALLS_H
 #define GTKMM_EXAMPLE_BALLS_H
 
+#include <string>
+#include <chrono>
+#include <vector>
 #include <glibmm/main.h>
 #include <gtkmm/drawingarea.h>
-#include <vector>
-#include <utility>
-#include <algorithm>
-#include <cmath>
-#include <random>
-#include <functional>
-#include <limits>
-
-#include "./vec2d.h"
-#include "./textbox.h"
 
-template <class It, class Func>
-void foreach_two(It beg, It end, Func &&func)
-{
-  using std::for_each;
-  while (beg != end)
-    {
-      auto &elem = *beg;
-      ++beg;
-      for_each(beg,end,[&elem,&func](auto &elem2)
-               {
-                 func(elem,elem2);
-               });
-    }
-}
+#include "./simulation.h"
+#include "./physics_thread.h"
+#include "./textbox.h"
+#include "./profiler.h"
+#include "./replay.h"
+#include "./renderer.h"
 
 class Balls : public Gtk::DrawingArea
 {
 public:
-  using seed_type = std::random_device::result_type;
-
-  const int time_lapse = 10;
-
-  struct Ball
+  using seed_type  = Simulation::seed_type;
+  using BroadPhase = Simulation::BroadPhase;
+  using Gravity    = Simulation::Gravity;
+
+  /**
+     Milliseconds between two redraws. The simulation runs at its own
+     rate on the physics thread.
+   */
+  static constexpr unsigned frame_interval = 16;
+
+  /**
+     At each redraw, only the areas of the balls that moved by a pixel
+     or more are invalidated. If more than this many balls moved, the
+     whole window is invalidated instead, which is cheaper than a
+     region made of many rectangles.
+   */
+  static constexpr std::size_t max_dirty_balls = 512;
+
+  /**
+     Size of the infobox in characters. With SIMUL_PROFILE, it also
+     shows the mean and the 99th percentile of each phase and counter.
+   */
+#ifdef SIMUL_PROFILE
+  static constexpr unsigned info_width  = 34;
+  static constexpr unsigned info_height = 11;
+#else
+  static constexpr unsigned info_width  = 18;
+  static constexpr unsigned info_height = 4;
+#endif
+
+  Balls(seed_type   seed,
+        std::size_t n_balls     = 10,
+        BroadPhase  broad_phase = BroadPhase::uniform_grid,
+        Gravity     gravity     = Gravity::pairwise,
+        double      theta       = 0.5)
+    : sim_(seed,n_balls,broad_phase,gravity,theta),
+      physics_(sim_),
+      infobox_(*this,info_width,info_height),
+      profiler_(),
+      replay_(),
+      last_tick_(clock::now()),
+      renderer_(),
+      snapshot_(nullptr),
+      drawn_(),
+      drawn_balls_(0),
+      drawn_width_(0),
+      drawn_height_(0),
+      drawn_frame_(0)
   {
-    Vec p;
-    Vec v;
-    double m;
-    double rad;
-    double color_r;
-    double color_g;
-    double color_b;
-
-    std::pair<Ball*,unsigned> recent_collision;
-
-    Ball(Vec pos,
-         Vec vel,
-         double mass = 0.1,
-         double r    = 0.2,
-         double g    = 0.2,
-         double b    = 0.2)
-      : p(pos),
-        v(vel),
-        m(mass),
-        rad(0.12 * mass),
-        color_r(r),
-        color_g(g),
-        color_b(b),
-        recent_collision(nullptr,0)
-    { }
-
-    Ball()
-      : Ball({0.0d,0.0d},{0.0d,0.0d})
-    { }
-  };
-
-
-  Ball random_ball()
-  {
-    static std::uniform_real_distribution<double> pos_dist(0,1);
-    static std::uniform_real_distribution<double> speed_dist(0.000001,0.00003);
-    static std::normal_distribution<double>       mass_dist(0.05,0.0);
-
-    return {
-        { pos_dist(rand_), pos_dist(rand_) },
-        { speed_dist(rand_), speed_dist(rand_) },
-          std::abs(mass_dist(rand_)),
-        pos_dist(rand_),pos_dist(rand_),pos_dist(rand_)
-    };
-  }
-
-
-  Balls(seed_type seed, std::size_t n_balls = 10)
-    : rand_(seed),
-      balls_(n_balls),
-      infobox_(*this,15,2)
-  {
-    Vec p { 0.08 , 0.0 };
-
-    using std::make_pair;
-    std::generate(begin(balls_),end(balls_),std::bind(&Balls::random_ball,this));
-    balls_.push_back(Ball { {0.5,0.5},{0.0,0.0},0.2,0.1,0.1,0.1 } );
-
     Glib::signal_timeout().connect(sigc::mem_fun(*this, &Balls::on_timeout),
-                                   time_lapse);
+                                   frame_interval);
+    set_can_focus(true);
+    add_events(Gdk::KEY_PRESS_MASK);
 
 #ifndef GLIBMM_DEFAULT_SIGNAL_HANDLERS_ENABLED
     // Connect the signal handler if it isn't already a virtual method
     // override:
 
     signal_draw().connect(sigc::mem_fun(*this, &Balls::on_draw), false);
+    signal_key_press_event().connect(sigc::mem_fun(*this, &Balls::on_key_press_event), false);
 #endif //GLIBMM_DEFAULT_SIGNAL_HANDLERS_ENABLED    
   }
 
   virtual ~Balls()
   { }
 
-protected:
-  virtual bool on_draw(const Cairo::RefPtr<Cairo::Context>& cr);
-
-  void update_balls()
+  /**
+     The simulation may only be configured before the main loop
+     starts. The physics thread takes it over at the first timeout.
+   */
+  Simulation &simulation()
+  { return sim_; }
+
+  PhysicsThread &physics()
+  { return physics_; }
+
+  /**
+     Timings of on_draw(), recorded with SIMUL_PROFILE.
+   */
+  Profiler &profiler()
+  { return profiler_; }
+
+  /**
+     Play back a trajectory recorded with TrajectoryWriter (e.g. by
+     simul-headless --record) instead of running the simulation. The
+     physics thread is never started then. Must be called before the
+     main loop starts. Returns false if the file can't be read.
+
+     Keys: space pauses, left and right go back and forward by a
+     second of playback (by one frame when paused), home and end go
+     to the first and last frame, + and - double and halve the speed.
+   */
+  bool replay(const std::string &path)
   {
-    for (auto &ball : balls_)
-      //    ball.p += ball.v;
-      ball.p += time_lapse * ball.v;
-
-    collisions();
+    return replay_.open(path);
   }
 
-  void collisions()
-  {
-    using std::make_pair;
-    using std::numeric_limits;
-    static const double eps = numeric_limits<double>::epsilon();
-
-    for (auto &ball : balls_)
-      {
-        if (ball.recent_collision.second > 0)
-          --ball.recent_collision.second;
-        if (ball.recent_collision.second == 0)
-          ball.recent_collision.first = nullptr;
-
-        /* Check for collisions with wall. */
-        if (ball.p.x - ball.rad < 0)
-          {
-            ball.p.x = ball.rad + eps;
-            ball.v.x = -ball.v.x;
-          }
-        if (ball.p.x + ball.rad > 1.0)
-          {
-            ball.p.x = 1.0 - ball.rad - eps;
-            ball.v.x = -ball.v.x;
-          }
-        if (ball.p.y - ball.rad < 0)
-          {
-            ball.p.y = ball.rad + eps;
-            ball.v.y = -ball.v.y;
-          }
-        if (ball.p.y + ball.rad > 1.0)
-          {
-            ball.p.y = 1 - ball.rad - eps;
-            ball.v.y = -ball.v.y;
-          }
-      }
-
-    /* Collisions. */
-    foreach_two(begin(balls_),end(balls_),[](auto &ball1, auto &ball2) {
-        static const double eps = numeric_limits<double>::epsilon();
-
-        if ((ball1.recent_collision.first == &ball2)
-            || (ball2.recent_collision.first == &ball1))
-          return;
-
-        auto deltap = ball1.p - ball2.p;
-        double sqr_dist = sqr(deltap.x) + sqr(deltap.y);
-        double sqr_rad  = sqr(ball1.rad + ball2.rad);
-
-        if (sqr_dist < sqr_rad)
-          {
-            if (sqr_dist < eps)
-              sqr_dist = eps;
-
-            /* Collision of two balls. */
-            double dist = ::sqrt(sqr_dist);
-            if (dist < eps)
-              dist = eps;
-            Vec min_trans_dist = ((ball1.rad + ball2.rad - dist) / dist) * deltap;
-
-            double sum_m = ball1.m + ball2.m;
-
-            Vec u1 = ball1.v;
-            Vec u2 = ball2.v;
-
-            ball1.v -=
-              (2*ball2.m / sum_m)
-              * (dot(u1 - u2,ball1.p - ball2.p) / norm(ball1.p - ball2.p))
-              * (ball1.p - ball2.p);
-
-            ball2.v -=
-              (2*ball1.m / sum_m)
-              * (dot(u2 - u1,ball2.p - ball1.p) / norm(ball2.p - ball1.p))
-              * (ball2.p - ball1.p);
-
-            ball1.p += ((1/ball1.m) / (1/ball1.m+1/ball2.m)) * min_trans_dist;
-            ball2.p -= ((1/ball2.m) / (1/ball1.m+1/ball2.m)) * min_trans_dist;
-
-            ball1.recent_collision = make_pair(&ball2,3);
-            ball2.recent_collision = make_pair(&ball1,3);
-          }
-      });
-
-    /* Effects of gravity. */
-    foreach_two(begin(balls_),end(balls_),[](auto &ball1, auto &ball2) {
-        Vec deltap = ball1.p - ball2.p;
-        if (deltap.len() > 0)
-          {
-            Vec force  = 0.00001 * ((ball1.m + ball2.m) / sqr(deltap.len())) * deltap;
-            ball1.v += force;
-            ball2.v -= force;
-          }
-      });
-  }
+  Replay &playback()
+  { return replay_; }
+
+  /**
+     How the balls are drawn (see renderer.h). The key r switches
+     between the methods.
+   */
+  Renderer &renderer()
+  { return renderer_; }
+
+protected:
+  virtual bool on_draw(const Cairo::RefPtr<Cairo::Context>& cr);
+  virtual bool on_key_press_event(GdkEventKey *event);
+  void invalidate_changes();
 
   bool on_timeout()
   {
     /**
-       Whenever we get the timeout signal, we invalidate the window to
-       force a redraw of its contents.
+       Whenever we get the timeout signal, we invalidate the parts of
+       the window that changed, to force a redraw of them. The physics
+       thread is started at the first timeout, when the main loop is
+       running. In replay mode, the playback is moved on instead.
     */
 
-    update_balls();
-
-    Glib::RefPtr<Gdk::Window> win = get_window();
-    if (win)
-      {
-        Gdk::Rectangle r(0,
-                         0,
-                         get_allocation().get_width(),
-                         get_allocation().get_height());
-        win->invalidate_rect(r, false);
-      }
+    const auto now = clock::now();
+    if (replay_.active())
+      replay_.advance(std::chrono::duration<double>(now - last_tick_).count());
+    else
+      physics_.start();
+    last_tick_ = now;
+
+    invalidate_changes();
     return true;
   }
 
-  std::default_random_engine rand_;
-  std::vector<Ball>          balls_;
-  Textbox                    infobox_;
+  Simulation    sim_;
+  PhysicsThread physics_;
+  Textbox       infobox_;
+  Profiler      profiler_;
+
+  using clock = std::chrono::steady_clock;
+
+  Replay            replay_;
+  clock::time_point last_tick_;
+  Renderer          renderer_;
+
+  /* The snapshot taken by the last invalidate_changes(), which
+     on_draw() draws, and the pixel areas of the balls in it, by id. */
+  const Snapshot                  *snapshot_;
+  std::vector<Cairo::RectangleInt> drawn_;
+  std::size_t                      drawn_balls_;
+  int                              drawn_width_;
+  int                              drawn_height_;
+  unsigned long                    drawn_frame_;
 };
 
 #endif // GTKMM_EXAMPLE_BALLS_H
@@ -0,0 +1,269 @@
+#ifndef GTKMM_EXAMPLE_BARNES_HUT_H
+#define GTKMM_EXAMPLE_BARNES_HUT_H
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cmath>
+
+#include "./vec.h"
+
+/**
+   Barnes–Hut approximation of the gravity pass.
+
+   The exact kernel changes the velocity of ball i by
+
+     G * (m_i + m_j) / |p_i - p_j|² * (p_i - p_j)
+
+   for every other ball j. The quadtree groups distant balls into
+   cells and replaces each such group by a single pseudo-ball at its
+   center of mass, carrying the total mass M and the number of balls
+   N of the group, so that the contribution of the group becomes
+
+     G * (N * m_i + M) / |p_i - c|² * (p_i - c)
+
+   A cell of width s at distance d from ball i is treated as one
+   pseudo-ball if s / d < theta (the opening angle). theta = 0 gives
+   the exact result, larger values are faster and less accurate.
+
+   Use as follows: call build() with the number of balls and
+   functions returning the position and mass of ball i, then call
+   field() for each ball.
+ */
+class QuadTree
+{
+public:
+  static constexpr unsigned max_depth = 48;
+
+  explicit QuadTree(double theta = 0.5)
+    : theta_(theta),
+      nodes_(),
+      next_(),
+      leaf_of_(),
+      pos_(),
+      mass_()
+  { }
+
+  double theta() const
+  { return theta_; }
+
+  void theta(double t)
+  { theta_ = t; }
+
+  template <class PosFunc, class MassFunc>
+  void build(std::size_t n, PosFunc &&pos, MassFunc &&mass)
+  {
+    pos_.resize(n);
+    mass_.resize(n);
+    next_.assign(n,none);
+    leaf_of_.resize(n);
+
+    /* The root covers the unit square, grown if any ball has
+       been pushed outside of it. */
+    double lo = 0.0;
+    double hi = 1.0;
+    for (std::size_t i = 0 ; i < n ; ++i)
+      {
+        pos_[i]  = pos(i);
+        mass_[i] = mass(i);
+        lo = std::min({ lo, pos_[i].x, pos_[i].y });
+        hi = std::max({ hi, pos_[i].x, pos_[i].y });
+      }
+
+    nodes_.clear();
+    nodes_.push_back(Node((lo + hi) / 2,(lo + hi) / 2,(hi - lo) / 2));
+    for (std::size_t i = 0 ; i < n ; ++i)
+      insert(i);
+    summarize();
+  }
+
+  /**
+     The change of velocity of ball i caused by all other balls,
+     with gravitational constant G.
+   */
+  Vec2d field(std::size_t i, double G) const
+  {
+    const Vec2d  p  = pos_[i];
+    const double mi = mass_[i];
+    Vec2d result {};
+
+    /* Each level pushes at most four nodes while popping one. */
+    std::size_t stack[3 * max_depth + 4];
+    std::size_t top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+      {
+        const Node &node = nodes_[stack[--top]];
+
+        if (node.count == 0)
+          continue;
+
+        if (node.first_child == none && node.depth == max_depth)
+          {
+            /* A bucket of (practically) coincident balls is taken as
+               one pseudo-ball, so that piles of balls stuck in a
+               corner don't cost quadratic time. For the balls inside
+               the bucket, the others count as coincident and exert
+               no force, as in the exact kernel. */
+            if (leaf_of_[i] != static_cast<std::size_t>(&node - nodes_.data()))
+              add(result,G,p - node.com,node.count * mi + node.mass);
+            continue;
+          }
+
+        if (node.first_child == none)
+          {
+            for (std::size_t j = node.body ; j != none ; j = next_[j])
+              if (j != i)
+                add(result,G,p - pos_[j],mi + mass_[j]);
+            continue;
+          }
+
+        const Vec2d  d    = p - node.com;
+        const double dist = len(d);
+        if (!node.contains(p) && 2 * node.half < theta_ * dist)
+          add(result,G,d,node.count * mi + node.mass);
+        else
+          for (std::size_t c = 0 ; c < 4 ; ++c)
+            stack[top++] = node.first_child + c;
+      }
+    return result;
+  }
+
+  std::size_t nodes() const
+  { return nodes_.size(); }
+
+private:
+  enum : std::size_t { none = static_cast<std::size_t>(-1) };
+
+  struct Node
+  {
+    double      cx;
+    double      cy;
+    double      half;
+    double      mass;
+    double      count;
+    Vec2d       com;
+    std::size_t first_child;
+    std::size_t body;
+    unsigned    depth;
+
+    Node(double x, double y, double h, unsigned d = 0)
+      : cx(x), cy(y), half(h),
+        mass(0.0), count(0.0), com(),
+        first_child(none), body(none), depth(d)
+    { }
+
+    bool contains(Vec2d p) const
+    {
+      return (std::abs(p.x - cx) <= half && std::abs(p.y - cy) <= half);
+    }
+
+    std::size_t quadrant(Vec2d p) const
+    {
+      return (p.x < cx ? 0 : 1) + (p.y < cy ? 0 : 2);
+    }
+  };
+
+  static void add(Vec2d &result, double G, Vec2d d, double m)
+  {
+    const double sqr_len = norm(d);
+    if (sqr_len > 0)
+      result += (G * m / sqr_len) * d;
+  }
+
+  void insert(std::size_t i)
+  {
+    std::size_t n = 0;
+    while (nodes_[n].first_child != none)
+      n = nodes_[n].first_child + nodes_[n].quadrant(pos_[i]);
+
+    if (nodes_[n].body == none || nodes_[n].depth == max_depth)
+      {
+        next_[i] = nodes_[n].body;
+        nodes_[n].body = i;
+        leaf_of_[i] = n;
+        return;
+      }
+
+    /* Split the leaf, then insert both balls again from here. */
+    split(n);
+    const std::size_t old = nodes_[n].body;
+    nodes_[n].body = none;
+    place(n,old);
+    place(n,i);
+  }
+
+  void place(std::size_t n, std::size_t i)
+  {
+    while (true)
+      {
+        n = nodes_[n].first_child + nodes_[n].quadrant(pos_[i]);
+        Node &node = nodes_[n];
+        if (node.body == none || node.depth == max_depth)
+          {
+            next_[i] = node.body;
+            node.body = i;
+            leaf_of_[i] = n;
+            return;
+          }
+        /* Both balls fall into the same quadrant. */
+        const std::size_t old = node.body;
+        node.body = none;
+        split(n);
+        place(n,old);
+      }
+  }
+
+  void split(std::size_t n)
+  {
+    const double   h  = nodes_[n].half / 2;
+    const double   cx = nodes_[n].cx;
+    const double   cy = nodes_[n].cy;
+    const unsigned d  = nodes_[n].depth + 1;
+
+    nodes_[n].first_child = nodes_.size();
+    nodes_.push_back(Node(cx - h,cy - h,h,d));
+    nodes_.push_back(Node(cx + h,cy - h,h,d));
+    nodes_.push_back(Node(cx - h,cy + h,h,d));
+    nodes_.push_back(Node(cx + h,cy + h,h,d));
+  }
+
+  /* Children are always created after their parent, so a
+     reverse sweep over the nodes visits children first. */
+  void summarize()
+  {
+    for (std::size_t n = nodes_.size() ; n-- > 0 ; )
+      {
+        Node &node = nodes_[n];
+        Vec2d weighted {};
+        if (node.first_child == none)
+          for (std::size_t j = node.body ; j != none ; j = next_[j])
+            {
+              node.mass  += mass_[j];
+              node.count += 1;
+              weighted   += mass_[j] * pos_[j];
+            }
+        else
+          for (std::size_t c = 0 ; c < 4 ; ++c)
+            {
+              const Node &child = nodes_[node.first_child + c];
+              node.mass  += child.mass;
+              node.count += child.count;
+              weighted   += child.mass * child.com;
+            }
+        if (node.mass > 0)
+          node.com = (1 / node.mass) * weighted;
+        else
+          node.com = { node.cx, node.cy };
+      }
+  }
+
+  double                   theta_;
+  std::vector<Node>        nodes_;
+  std::vector<std::size_t> next_;
+  std::vector<std::size_t> leaf_of_;
+  std::vector<Vec2d>       pos_;
+  std::vector<double>      mass_;
+};
+
+#endif // GTKMM_EXAMPLE_BARNES_HUT_H
@@ -0,0 +1,109 @@
+/*
+  Draw time against the number of balls, for each method of the
+  Renderer (renderer.h): per ball, batched by color, blitted from
+  the sprite cache, and rasterized in software on all cores.
+
+  Build as:
+
+  g++ -O3 -W -Wall -std=c++1y -pthread -o bench-draw bench/draw.cpp kernels.cpp `pkg-config cairomm-1.0 --cflags --libs`
+
+  The balls are drawn into an 800x800 image surface, so that the
+  times don't depend on the display. As in bench/physics.cpp, the
+  balls are those of random_ball(), with the radius scaled down for
+  large counts to keep the covered fraction of the window constant;
+  at a million balls, they are smaller than a pixel.
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <functional>
+#include <cmath>
+#include <thread>
+
+#include <cairomm/context.h>
+#include <cairomm/surface.h>
+
+#include "../simulation.h"
+#include "../renderer.h"
+
+namespace {
+
+constexpr int    size     = 800;
+constexpr double coverage = 0.1;
+
+Particles make_balls(std::size_t n)
+{
+  Simulation sim(23,0);
+  const double max_rad = ::sqrt(coverage / (M_PI * n));
+  Particles balls;
+  balls.reserve(n);
+  for (std::size_t i = 0 ; i < n ; ++i)
+    {
+      Ball ball = sim.random_ball();
+      ball.rad = std::min(ball.rad,max_rad);
+      balls.push_back(ball);
+    }
+  return balls;
+}
+
+/* Seconds per call of func, averaged over enough calls to take
+   about half a second. */
+double time_of(const std::function<void()> &func)
+{
+  using clock = std::chrono::steady_clock;
+  unsigned reps = 1;
+  while (true)
+    {
+      const auto start = clock::now();
+      for (unsigned r = 0 ; r < reps ; ++r)
+        func();
+      const double secs = std::chrono::duration<double>(clock::now() - start).count();
+      if (secs > 0.5)
+        return secs / reps;
+      reps *= 2;
+    }
+}
+
+} // namespace
+
+int main()
+{
+  auto surface = Cairo::ImageSurface::create(Cairo::FORMAT_RGB24,size,size);
+  auto cr      = Cairo::Context::create(surface);
+
+  std::cout << std::setw(10) << "n" << std::setw(14) << "per ball ms"
+            << std::setw(14) << "batched ms" << std::setw(14) << "sprites ms"
+            << std::setw(14) << "raster ms" << '\n';
+
+  Renderer renderer;
+  renderer.threads(std::thread::hardware_concurrency());
+  for (std::size_t n : { 1000, 5000, 10000, 50000, 100000, 1000000 })
+    {
+      const Particles balls = make_balls(n);
+      auto frame = [&]() {
+        cr->set_source_rgb(1.0,1.0,1.0);
+        cr->paint();
+        renderer.draw(cr,balls,size,size);
+        surface->flush();
+      };
+
+      renderer.method(Renderer::Method::per_ball);
+      const double per_ball = time_of(frame);
+      renderer.method(Renderer::Method::batched);
+      const double batched  = time_of(frame);
+      renderer.method(Renderer::Method::sprites);
+      const double sprites  = time_of(frame);
+      renderer.method(Renderer::Method::raster);
+      const double raster   = time_of(frame);
+
+      std::cout << std::setw(10) << n
+                << std::fixed << std::setprecision(3)
+                << std::setw(14) << per_ball * 1e3
+                << std::setw(14) << batched * 1e3
+                << std::setw(14) << sprites * 1e3
+                << std::setw(14) << raster * 1e3
+                << '\n';
+    }
+  return 0;
+}
@@ -0,0 +1,168 @@
+/*
+  Micro-benchmark of the vectorized kernels in kernels.h.
+
+  Build as:
+
+  g++ -O3 -W -Wall -std=c++1y -o bench-kernels bench/kernels.cpp kernels.cpp
+
+  For each kernel, each set of kernels the CPU supports, and both
+  number types (double and float, see policy.h), this prints the time
+  per ball (per pair, for gravity) and the speedup against the scalar
+  set of the same type, and checks that the results are bit-identical
+  to those of the scalar set.
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <functional>
+
+#include "../kernels.h"
+
+namespace {
+
+template <class T>
+struct State
+{
+  std::vector<T> x, y, vx, vy, m, rad, dvx, dvy;
+
+  State(std::size_t n, unsigned seed)
+    : x(n), y(n), vx(n), vy(n), m(n), rad(n), dvx(n), dvy(n)
+  {
+    std::default_random_engine rand(seed);
+    std::uniform_real_distribution<double> pos_dist(-0.01,1.01);
+    std::uniform_real_distribution<double> speed_dist(-0.00003,0.00003);
+    std::uniform_real_distribution<double> mass_dist(0.01,0.2);
+    for (std::size_t i = 0 ; i < n ; ++i)
+      {
+        x[i]   = pos_dist(rand);
+        y[i]   = pos_dist(rand);
+        vx[i]  = speed_dist(rand);
+        vy[i]  = speed_dist(rand);
+        m[i]   = mass_dist(rand);
+        rad[i] = 0.12 * m[i];
+      }
+  }
+
+  bool operator==(const State &other) const
+  {
+    auto same = [](const std::vector<T> &a, const std::vector<T> &b) {
+      return (std::memcmp(a.data(),b.data(),a.size() * sizeof(T)) == 0);
+    };
+    return (same(x,other.x) && same(y,other.y) && same(vx,other.vx)
+            && same(vy,other.vy) && same(dvx,other.dvx) && same(dvy,other.dvy));
+  }
+};
+
+/* Seconds per call of func, averaged over enough calls to take
+   about a tenth of a second. */
+double time_of(const std::function<void()> &func)
+{
+  using clock = std::chrono::steady_clock;
+  unsigned reps = 1;
+  while (true)
+    {
+      const auto start = clock::now();
+      for (unsigned r = 0 ; r < reps ; ++r)
+        func();
+      const double secs = std::chrono::duration<double>(clock::now() - start).count();
+      if (secs > 0.1)
+        return secs / reps;
+      reps *= 2;
+    }
+}
+
+/* Time and compare all sets of kernels for numbers of type T.
+   Returns whether all results were identical. */
+template <class T>
+bool run_sets(const char *type)
+{
+  using Set = KernelSet<T,2>;
+  const T eps = std::numeric_limits<T>::epsilon();
+  const std::vector<const Set*> sets {
+    &scalar_kernels<T,2>(), &sse2_kernels<T,2>(), &avx2_kernels<T,2>()
+  };
+
+  bool all_identical = true;
+  for (std::size_t n : { 1003, 100003 })
+    {
+      const State<T> reference(n,23);
+
+      for (const char *kernel : { "integrate", "walls", "gravity" })
+        {
+          const bool   is_gravity = (std::strcmp(kernel,"gravity") == 0);
+          /* Gravity is quadratic, so it only runs on a slice of the
+             balls. */
+          const std::size_t rows  = (is_gravity ? std::min<std::size_t>(n,1000) : n);
+          const double      items = (is_gravity ? double(rows) * n : double(n));
+
+          State<T> expected = reference;
+          double   scalar_time = 0.0;
+          for (const Set *set : sets)
+            {
+              if (!kernels_supported(*set))
+                continue;
+
+              auto run = [&](State<T> &s) {
+                if (std::strcmp(kernel,"integrate") == 0)
+                  {
+                    set->integrate(s.x.data(),s.vx.data(),n,10);
+                    set->integrate(s.y.data(),s.vy.data(),n,10);
+                  }
+                else if (!is_gravity)
+                  {
+                    set->walls(s.x.data(),s.vx.data(),s.rad.data(),n,eps);
+                    set->walls(s.y.data(),s.vy.data(),s.rad.data(),n,eps);
+                  }
+                else
+                  {
+                    const T *const p[] = { s.x.data(), s.y.data() };
+                    T *const dv[] = { s.dvx.data(), s.dvy.data() };
+                    set->gravity(p,s.m.data(),n,0,rows,T(0.00001),dv);
+                  }
+              };
+
+              /* One run on a fresh copy for the comparison, then the
+                 timing on another copy. */
+              State<T> result = reference;
+              run(result);
+              if (set == sets[0])
+                expected = result;
+              const bool identical = (result == expected);
+              all_identical = all_identical && identical;
+
+              State<T> scratch = reference;
+              const double t = time_of([&]() { run(scratch); });
+              if (set == sets[0])
+                scalar_time = t;
+
+              std::cout << std::setw(10) << kernel << std::setw(8) << type
+                        << std::setw(8) << set->name << std::setw(10) << n
+                        << std::setw(14) << std::fixed << std::setprecision(3)
+                        << t * 1e9 / items
+                        << std::setw(9) << std::setprecision(2) << scalar_time / t << 'x'
+                        << std::setw(11) << (identical ? "yes" : "NO")
+                        << '\n';
+            }
+        }
+    }
+  return all_identical;
+}
+
+} // namespace
+
+int main()
+{
+  std::cout << std::setw(10) << "kernel" << std::setw(8) << "type" << std::setw(8) << "set"
+            << std::setw(10) << "n" << std::setw(14) << "ns/item"
+            << std::setw(10) << "speedup" << std::setw(11) << "identical"
+            << '\n';
+
+  const bool doubles = run_sets<double>("double");
+  const bool floats  = run_sets<float>("float");
+  return (doubles && floats ? 0 : 1);
+}
@@ -0,0 +1,207 @@
+/*
+  Benchmark of the phases of the physics step, using Google Benchmark.
+
+  Build as:
+
+  g++ -O3 -W -Wall -Wno-parentheses -std=c++1y -pthread -o bench-physics bench/physics.cpp kernels.cpp -lbenchmark
+
+  Each phase of Simulation::step() (integration, walls, collisions,
+  gravity) is timed on its own, for 100 to 1M balls, placed either
+  uniformly as by random_ball() or in a few dense clusters. Use
+
+  ./bench-physics --benchmark_out=physics.json --benchmark_out_format=json
+
+  to keep the results for comparison with another version, and
+  --benchmark_filter to run only some of them.
+
+  The balls are those of random_ball(), but for more than about a
+  thousand of them the radius is scaled down, so that they cover the
+  same fraction of the square at every n (otherwise a million balls
+  would all overlap). The big ball in the middle is left out, since
+  it would set the cell width of the grid.
+
+  The approximate gravity methods (Barnes–Hut, particle mesh, cutoff) also
+  report their relative RMS error against the exact kernel
+  (Simulation::gravity_error()) as the counter "error", for the
+  fresh random balls; in a run, the headless program prints it at
+  the end.
+
+  The balls come in random order. The grid collisions and the
+  Barnes–Hut gravity are also timed with the balls sorted along a
+  Morton curve first (Simulation::sort_spatially()), as step() does
+  every few steps.
+*/
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <utility>
+
+#include <benchmark/benchmark.h>
+
+#include "../simulation.h"
+
+namespace {
+
+using BroadPhase = Simulation::BroadPhase;
+using Gravity    = Simulation::Gravity;
+
+enum Distribution { uniform, clustered };
+enum Order { random_order, sorted };
+
+/* Fraction of the unit square covered by the balls, at most. */
+constexpr double coverage = 0.1;
+
+constexpr unsigned clusters      = 16;
+constexpr double   cluster_sigma = 0.03;
+
+/**
+   A simulation of n balls from the given distribution, with one
+   (untimed) step done, so that the first overlaps are resolved and
+   the Barnes–Hut error isn't sampled during the timing.
+ */
+Simulation make_simulation(std::size_t n, Distribution dist,
+                           BroadPhase broad_phase = BroadPhase::uniform_grid,
+                           Order order = random_order)
+{
+  Simulation sim(23,0,broad_phase,Gravity::none);
+  sim.threads(1);
+  sim.sort_interval(0);
+
+  std::default_random_engine rand(42);
+  std::uniform_real_distribution<double> pos_dist(0.1,0.9);
+  std::normal_distribution<double>       offset_dist(0.0,cluster_sigma);
+  std::vector<Vec2d> centers;
+  for (unsigned c = 0 ; c < clusters ; ++c)
+    centers.push_back({ pos_dist(rand), pos_dist(rand) });
+
+  const double max_rad = ::sqrt(coverage / (M_PI * n));
+  Particles balls;
+  balls.reserve(n);
+  for (std::size_t i = 0 ; i < n ; ++i)
+    {
+      Ball ball = sim.random_ball();
+      ball.rad = std::min(ball.rad,max_rad);
+      if (dist == clustered)
+        {
+          const Vec2d &center = centers[i % clusters];
+          ball.p = { center.x + offset_dist(rand), center.y + offset_dist(rand) };
+          ball.p.x = std::min(std::max(ball.p.x,ball.rad),1.0 - ball.rad);
+          ball.p.y = std::min(std::max(ball.p.y,ball.rad),1.0 - ball.rad);
+        }
+      balls.push_back(ball);
+    }
+
+  sim.balls(std::move(balls));
+  sim.step();
+  if (order == sorted)
+    sim.sort_spatially();
+  return sim;
+}
+
+void set_counters(benchmark::State &state, Order order = random_order)
+{
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.SetLabel(std::string(state.range(1) == clustered ? "clustered" : "uniform")
+                 + (order == sorted ? ",sorted" : ""));
+}
+
+void BM_Integrate(benchmark::State &state)
+{
+  Simulation sim = make_simulation(state.range(0),Distribution(state.range(1)));
+  for (auto _ : state)
+    sim.integrate();
+  set_counters(state);
+}
+
+void BM_Walls(benchmark::State &state)
+{
+  Simulation sim = make_simulation(state.range(0),Distribution(state.range(1)));
+  for (auto _ : state)
+    sim.walls();
+  set_counters(state);
+}
+
+/* The positions don't change between two calls of collisions(), so
+   each iteration tests the same pairs. */
+template <BroadPhase broad_phase>
+void BM_Collisions(benchmark::State &state)
+{
+  const Order order = (broad_phase != BroadPhase::all_pairs ? Order(state.range(2)) : random_order);
+  Simulation sim = make_simulation(state.range(0),Distribution(state.range(1)),broad_phase,order);
+  double contacts = 0;
+  for (auto _ : state)
+    {
+      sim.collisions();
+      contacts += sim.contacts();
+    }
+  state.counters["contacts"] = benchmark::Counter(contacts,benchmark::Counter::kAvgIterations);
+  set_counters(state,order);
+}
+
+template <Gravity gravity>
+void BM_Gravity(benchmark::State &state)
+{
+  const Order order = (gravity == Gravity::barnes_hut ? Order(state.range(2)) : random_order);
+  Simulation sim = make_simulation(state.range(0),Distribution(state.range(1)),
+                                   BroadPhase::uniform_grid,order);
+  sim.gravity(gravity);
+  if (gravity == Gravity::cutoff)
+    sim.mesh_size(state.range(2));
+  for (auto _ : state)
+    sim.gravitation();
+  if (sim.approximate())
+    state.counters["error"] = sim.gravity_error();
+  set_counters(state,order);
+}
+
+/* The quadratic methods stop at a smaller n. */
+void all_sizes(benchmark::internal::Benchmark *b)
+{
+  b->ArgsProduct({ { 100, 1000, 10000, 100000, 1000000 }, { uniform, clustered } });
+}
+
+void small_sizes(benchmark::internal::Benchmark *b)
+{
+  b->ArgsProduct({ { 100, 1000, 10000 }, { uniform, clustered } });
+}
+
+/* The exact part of the cutoff method grows as n² over the cells of
+   the mesh, so a finer mesh is taken for more balls. */
+void mesh_sizes(benchmark::internal::Benchmark *b)
+{
+  for (long dist : { uniform, clustered })
+    for (const auto &args : { std::make_pair(100,128), std::make_pair(1000,128),
+                              std::make_pair(10000,128), std::make_pair(100000,512),
+                              std::make_pair(1000000,1024) })
+      b->Args({ args.first, dist, args.second });
+}
+
+void sorted_sizes(benchmark::internal::Benchmark *b)
+{
+  b->ArgsProduct({ { 100, 1000, 10000, 100000, 1000000 }, { uniform, clustered },
+                   { random_order, sorted } });
+}
+
+} // namespace
+
+BENCHMARK(BM_Integrate)->Apply(all_sizes)->ArgNames({"n","dist"})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Walls)->Apply(all_sizes)->ArgNames({"n","dist"})->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_Collisions,BroadPhase::uniform_grid)
+  ->Apply(sorted_sizes)->ArgNames({"n","dist","sorted"})->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_Collisions,BroadPhase::neighbor_list)
+  ->Apply(sorted_sizes)->ArgNames({"n","dist","sorted"})->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_Collisions,BroadPhase::all_pairs)
+  ->Apply(small_sizes)->ArgNames({"n","dist"})->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_Gravity,Gravity::barnes_hut)
+  ->Apply(sorted_sizes)->ArgNames({"n","dist","sorted"})->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_Gravity,Gravity::particle_mesh)
+  ->Apply(all_sizes)->ArgNames({"n","dist"})->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_Gravity,Gravity::cutoff)
+  ->Apply(mesh_sizes)->ArgNames({"n","dist","mesh"})->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_Gravity,Gravity::pairwise)
+  ->Apply(small_sizes)->ArgNames({"n","dist"})->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
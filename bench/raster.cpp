@@ -0,0 +1,86 @@
+/*
+  Draw time of the software rasterizer (raster.h) against the number
+  of balls, on one thread and on all cores. This is the raster column
+  of bench/draw.cpp without Cairo, so it builds anywhere:
+
+  g++ -O3 -W -Wall -std=c++1y -pthread -o bench-raster bench/raster.cpp kernels.cpp
+
+  The balls and the image are those of bench/draw.cpp: random_ball()
+  with the radius scaled down for large counts to keep the covered
+  fraction of the image constant, drawn into 800x800 pixels.
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <functional>
+#include <cmath>
+#include <thread>
+
+#include "../simulation.h"
+#include "../raster.h"
+
+namespace {
+
+constexpr int    size     = 800;
+constexpr double coverage = 0.1;
+
+Particles make_balls(std::size_t n)
+{
+  Simulation sim(23,0);
+  const double max_rad = ::sqrt(coverage / (M_PI * n));
+  Particles balls;
+  balls.reserve(n);
+  for (std::size_t i = 0 ; i < n ; ++i)
+    {
+      Ball ball = sim.random_ball();
+      ball.rad = std::min(ball.rad,max_rad);
+      balls.push_back(ball);
+    }
+  return balls;
+}
+
+/* Seconds per call of func, averaged over enough calls to take
+   about half a second. */
+double time_of(const std::function<void()> &func)
+{
+  using clock = std::chrono::steady_clock;
+  unsigned reps = 1;
+  while (true)
+    {
+      const auto start = clock::now();
+      for (unsigned r = 0 ; r < reps ; ++r)
+        func();
+      const double secs = std::chrono::duration<double>(clock::now() - start).count();
+      if (secs > 0.5)
+        return secs / reps;
+      reps *= 2;
+    }
+}
+
+} // namespace
+
+int main()
+{
+  const unsigned cores = std::max(1u,std::thread::hardware_concurrency());
+  std::cout << "cores: " << cores << '\n'
+            << std::setw(10) << "n" << std::setw(14) << "1 thread ms"
+            << std::setw(14) << "all cores ms" << '\n';
+
+  Rasterizer one;
+  Rasterizer all;
+  all.threads(cores);
+  for (std::size_t n : { 1000, 5000, 10000, 50000, 100000, 1000000 })
+    {
+      const Particles balls = make_balls(n);
+      const double single   = time_of([&]() { one.render(balls,size,size); });
+      const double parallel = time_of([&]() { all.render(balls,size,size); });
+
+      std::cout << std::setw(10) << n
+                << std::fixed << std::setprecision(3)
+                << std::setw(14) << single * 1e3
+                << std::setw(14) << parallel * 1e3
+                << '\n';
+    }
+  return 0;
+}
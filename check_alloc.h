@@ -0,0 +1,132 @@
+#ifndef GTKMM_EXAMPLE_CHECK_ALLOC_H
+#define GTKMM_EXAMPLE_CHECK_ALLOC_H
+
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+
+/**
+   Replacements of all forms of the global operator new and delete
+   that count the allocations of the program, on all threads, in
+   check_alloc::allocations.
+
+   All forms of operator new take the memory from malloc(), or from
+   posix_memalign() where it has to be aligned beyond that, and all
+   forms of operator delete give it back to free(), so that every new
+   has its matching delete whichever form the compiler picks. None of
+   them is inlined, so that the compiler doesn't take the malloc() and
+   free() inside for a mismatch with the new and delete expressions of
+   the callers.
+
+   The replacements are definitions, so this is to be included in one
+   translation unit of a program only.
+ */
+namespace check_alloc {
+
+std::atomic<unsigned long> allocations(0);
+
+__attribute__((noinline))
+void *allocate(std::size_t size, std::size_t align) noexcept
+{
+  allocations.fetch_add(1,std::memory_order_relaxed);
+  size = (size > 0 ? size : 1);
+  if (align <= alignof(std::max_align_t))
+    return std::malloc(size);
+  void *p = nullptr;
+  return (::posix_memalign(&p,align,size) == 0 ? p : nullptr);
+}
+
+__attribute__((noinline))
+void *allocate_or_throw(std::size_t size, std::size_t align)
+{
+  if (void *p = allocate(size,align))
+    return p;
+  throw std::bad_alloc();
+}
+
+} // namespace check_alloc
+
+__attribute__((noinline))
+void *operator new(std::size_t size)
+{ return check_alloc::allocate_or_throw(size,0); }
+
+__attribute__((noinline))
+void *operator new[](std::size_t size)
+{ return check_alloc::allocate_or_throw(size,0); }
+
+__attribute__((noinline))
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{ return check_alloc::allocate(size,0); }
+
+__attribute__((noinline))
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{ return check_alloc::allocate(size,0); }
+
+__attribute__((noinline))
+void operator delete(void *p) noexcept
+{ std::free(p); }
+
+__attribute__((noinline))
+void operator delete[](void *p) noexcept
+{ std::free(p); }
+
+__attribute__((noinline))
+void operator delete(void *p, std::size_t) noexcept
+{ std::free(p); }
+
+__attribute__((noinline))
+void operator delete[](void *p, std::size_t) noexcept
+{ std::free(p); }
+
+__attribute__((noinline))
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{ std::free(p); }
+
+__attribute__((noinline))
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{ std::free(p); }
+
+#ifdef __cpp_aligned_new
+__attribute__((noinline))
+void *operator new(std::size_t size, std::align_val_t align)
+{ return check_alloc::allocate_or_throw(size,std::size_t(align)); }
+
+__attribute__((noinline))
+void *operator new[](std::size_t size, std::align_val_t align)
+{ return check_alloc::allocate_or_throw(size,std::size_t(align)); }
+
+__attribute__((noinline))
+void *operator new(std::size_t size, std::align_val_t align, const std::nothrow_t &) noexcept
+{ return check_alloc::allocate(size,std::size_t(align)); }
+
+__attribute__((noinline))
+void *operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t &) noexcept
+{ return check_alloc::allocate(size,std::size_t(align)); }
+
+__attribute__((noinline))
+void operator delete(void *p, std::align_val_t) noexcept
+{ std::free(p); }
+
+__attribute__((noinline))
+void operator delete[](void *p, std::align_val_t) noexcept
+{ std::free(p); }
+
+__attribute__((noinline))
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept
+{ std::free(p); }
+
+__attribute__((noinline))
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept
+{ std::free(p); }
+
+__attribute__((noinline))
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept
+{ std::free(p); }
+
+__attribute__((noinline))
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept
+{ std::free(p); }
+#endif
+
+#endif // GTKMM_EXAMPLE_CHECK_ALLOC_H
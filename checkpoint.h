@@ -0,0 +1,402 @@
+#ifndef GTKMM_EXAMPLE_CHECKPOINT_H
+#define GTKMM_EXAMPLE_CHECKPOINT_H
+
+#include <string>
+#include <vector>
+#include <streambuf>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "./particles.h"
+
+/**
+   The state of a simulation that is needed to continue it later: the
+   balls, the number of steps done, and the state of the random
+   number engine (as written by its operator<<).
+ */
+struct Checkpoint
+{
+  Particles     balls;
+  unsigned long steps = 0;
+  std::string   rng;
+};
+
+/**
+   Binary file format of a Checkpoint, in the byte order of the
+   machine that wrote it:
+
+     Header
+     the random number engine state, as text
+     x, y, vx, vy, m, rad   (arrays of n reals, see policy.h)
+     cold                   (array of n ColdRecord)
+
+   Each array starts at the offset given in the header, a multiple of
+   align, so that it can be read straight out of a mapping
+   of the file. A reader rejects a file with another magic, version,
+   byte order, or size of a real.
+ */
+namespace checkpoint_format {
+
+enum : std::uint32_t { version = 3, byte_order = 0x01020304 };
+enum : std::size_t { align = 64 };
+
+enum Array : std::size_t { x, y, vx, vy, m, rad, cold, arrays };
+
+struct Header
+{
+  char          magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint32_t real_size;
+  std::uint32_t unused;
+  std::uint64_t balls;
+  std::uint64_t steps;
+  std::uint64_t rng_offset;
+  std::uint64_t rng_size;
+  std::uint64_t offset[arrays];
+  std::uint64_t file_size;
+};
+
+struct ColdRecord
+{
+  double        color_r;
+  double        color_g;
+  double        color_b;
+  std::uint64_t id;
+  std::uint64_t recent_ball;
+  std::uint32_t recent_steps;
+  std::uint32_t calm;
+};
+
+static const char magic[8] = { 'S','I','M','U','L','C','K','P' };
+
+inline std::uint64_t aligned(std::uint64_t offset)
+{ return (offset + align - 1) / align * align; }
+
+/* The header of a checkpoint of the given size, with the offsets
+   filled in. */
+inline Header layout(std::uint64_t n, std::uint64_t rng_size)
+{
+  Header h;
+  std::memset(&h,0,sizeof(h));
+  std::memcpy(h.magic,magic,sizeof(magic));
+  h.version    = version;
+  h.byte_order = byte_order;
+  h.real_size  = sizeof(real);
+  h.balls      = n;
+  h.rng_offset = sizeof(Header);
+  h.rng_size   = rng_size;
+
+  std::uint64_t offset = h.rng_offset + rng_size;
+  for (std::size_t a = 0 ; a < arrays ; ++a)
+    {
+      offset      = aligned(offset);
+      h.offset[a] = offset;
+      offset     += n * (a == cold ? sizeof(ColdRecord) : sizeof(real));
+    }
+  h.file_size = offset;
+  return h;
+}
+
+/* Write state to tmp and rename it to path. The cold entries are
+   converted in blocks on the stack, so that nothing is allocated
+   (but by the C library, for the file). */
+inline bool write(const char *path, const char *tmp, const Checkpoint &state)
+{
+  const Particles  &balls = state.balls;
+  const std::size_t n     = balls.size();
+  Header h = layout(n,state.rng.size());
+  h.steps = state.steps;
+
+  std::FILE *file = std::fopen(tmp,"wb");
+  if (!file)
+    return false;
+
+  std::uint64_t pos = 0;
+  auto put = [&](const void *data, std::uint64_t offset, std::uint64_t size) {
+    static const char zeros[align] = { };
+    std::fwrite(zeros,1,offset - pos,file);
+    std::fwrite(data,1,size,file);
+    pos = offset + size;
+  };
+
+  put(&h,0,sizeof(h));
+  put(state.rng.data(),h.rng_offset,h.rng_size);
+  const std::vector<real> *hot[] = {
+    &balls.x, &balls.y, &balls.vx, &balls.vy, &balls.m, &balls.rad
+  };
+  for (std::size_t a = 0 ; a < cold ; ++a)
+    put(hot[a]->data(),h.offset[a],n * sizeof(real));
+
+  ColdRecord records[256];
+  for (std::size_t b = 0 ; b < n ; b += 256)
+    {
+      const std::size_t e = std::min<std::size_t>(b + 256,n);
+      for (std::size_t i = b ; i < e ; ++i)
+        {
+          const Particles::Cold &c = balls.cold[i];
+          records[i - b] = { c.color_r, c.color_g, c.color_b, c.id,
+                             c.recent_collision.first, c.recent_collision.second, c.calm };
+        }
+      put(records,h.offset[cold] + b * sizeof(ColdRecord),(e - b) * sizeof(ColdRecord));
+    }
+
+  const bool ok = !std::ferror(file);
+  if (std::fclose(file) != 0 || !ok)
+    {
+      std::remove(tmp);
+      return false;
+    }
+  return (std::rename(tmp,path) == 0);
+}
+
+/* Output stream buffer that appends to a string, which keeps its
+   capacity from one checkpoint to the next. */
+class StringAppender : public std::streambuf
+{
+public:
+  explicit StringAppender(std::string &out)
+    : out_(out)
+  { }
+
+protected:
+  int_type overflow(int_type c) override
+  {
+    if (!traits_type::eq_int_type(c,traits_type::eof()))
+      out_.push_back(traits_type::to_char_type(c));
+    return traits_type::not_eof(c);
+  }
+
+  std::streamsize xsputn(const char *data, std::streamsize size) override
+  {
+    out_.append(data,size);
+    return size;
+  }
+
+private:
+  std::string &out_;
+};
+
+} // namespace checkpoint_format
+
+/**
+   Write a checkpoint to path. The file is written under a temporary
+   name and renamed at the end, so that a crash never leaves a
+   half-written checkpoint behind. Returns false if it can't be
+   written.
+ */
+inline bool write_checkpoint(const std::string &path, const Checkpoint &state)
+{ return checkpoint_format::write(path.c_str(),(path + ".tmp").c_str(),state); }
+
+/**
+   Read a checkpoint from path into state. The file is mapped into
+   memory, and each array is taken over with a single copy from the
+   mapping (the page cache, for a file written recently), so that
+   restoring a million balls costs no more than copying their arrays.
+   Returns false if the file can't be read or is not a checkpoint of
+   this version.
+ */
+inline bool read_checkpoint(const std::string &path, Checkpoint &state)
+{
+  using namespace checkpoint_format;
+
+  const int fd = ::open(path.c_str(),O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (::fstat(fd,&st) != 0 || std::uint64_t(st.st_size) < sizeof(Header))
+    {
+      ::close(fd);
+      return false;
+    }
+  const std::size_t size = st.st_size;
+  void *map = ::mmap(nullptr,size,PROT_READ,MAP_PRIVATE,fd,0);
+  ::close(fd);
+  if (map == MAP_FAILED)
+    return false;
+  ::madvise(map,size,MADV_SEQUENTIAL);
+
+  const char *base = static_cast<const char*>(map);
+  Header h;
+  std::memcpy(&h,base,sizeof(h));
+  bool ok = (std::memcmp(h.magic,magic,sizeof(magic)) == 0
+             && h.version == version && h.byte_order == byte_order
+             && h.real_size == sizeof(real));
+  if (ok)
+    {
+      const Header expected = layout(h.balls,h.rng_size);
+      ok = (h.file_size == size && expected.file_size == size
+            && h.rng_offset == expected.rng_offset);
+      for (std::size_t a = 0 ; a < arrays ; ++a)
+        ok = ok && (h.offset[a] == expected.offset[a]);
+    }
+
+  if (ok)
+    {
+      const std::size_t n     = h.balls;
+      Particles        &balls = state.balls;
+      std::vector<real> *hot[] = {
+        &balls.x, &balls.y, &balls.vx, &balls.vy, &balls.m, &balls.rad
+      };
+      for (std::size_t a = 0 ; a < cold ; ++a)
+        {
+          const real *data = reinterpret_cast<const real*>(base + h.offset[a]);
+          hot[a]->assign(data,data + n);
+        }
+
+      const ColdRecord *records = reinterpret_cast<const ColdRecord*>(base + h.offset[cold]);
+      balls.cold.resize(n);
+      for (std::size_t i = 0 ; i < n ; ++i)
+        balls.cold[i] = { records[i].color_r, records[i].color_g, records[i].color_b,
+                          records[i].id, { records[i].recent_ball, records[i].recent_steps },
+                          records[i].calm };
+
+      state.steps = h.steps;
+      state.rng.assign(base + h.rng_offset,h.rng_size);
+    }
+
+  ::munmap(map,size);
+  return ok;
+}
+
+/**
+   Writes checkpoints on a background thread, so that the thread
+   running the simulation only pays for copying its state.
+
+   save() hands a checkpoint over and returns at once. If the previous
+   one is still being written, the new one waits its turn, and if
+   several are handed over in the meantime, only the newest of them
+   is written.
+
+   The checkpoints and the paths are kept in buffers that are swapped
+   around, so that once each of them has been used, neither thread
+   allocates memory for a checkpoint of the same size.
+ */
+class CheckpointWriter
+{
+public:
+  CheckpointWriter()
+    : mutex_(),
+      wake_(),
+      back_(),
+      pending_(),
+      pending_path_(),
+      path_(),
+      tmp_(),
+      has_pending_(false),
+      busy_(false),
+      stop_(false),
+      failures_(0),
+      thread_(&CheckpointWriter::run,this)
+  { }
+
+  CheckpointWriter(const CheckpointWriter &) = delete;
+  CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+
+  ~CheckpointWriter()
+  {
+    wait();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+  }
+
+  /**
+     The checkpoint to be written. Fill it (e.g. with
+     Simulation::save()) and call save(); until then, the writer
+     doesn't touch it. Its buffers are reused from one checkpoint to
+     the next.
+   */
+  Checkpoint &back()
+  { return back_; }
+
+  /**
+     Write back() to path in the background.
+   */
+  void save(const std::string &path)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::swap(back_,pending_);
+      pending_path_ = path;
+      has_pending_  = true;
+    }
+    wake_.notify_all();
+  }
+
+  /**
+     Wait until all checkpoints handed over have been written.
+   */
+  void wait()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    wake_.wait(lock,[this]() { return !has_pending_ && !busy_; });
+  }
+
+  /**
+     Number of checkpoints that could not be written.
+   */
+  unsigned failures() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failures_;
+  }
+
+private:
+  void run()
+  {
+    Checkpoint writing;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+      {
+        wake_.wait(lock,[this]() { return has_pending_ || stop_; });
+        if (!has_pending_)
+          return;
+
+        std::swap(writing,pending_);
+        std::swap(path_,pending_path_);
+        has_pending_ = false;
+        busy_        = true;
+        lock.unlock();
+
+        tmp_.assign(path_);
+        tmp_.append(".tmp");
+        const bool ok = checkpoint_format::write(path_.c_str(),tmp_.c_str(),writing);
+
+        lock.lock();
+        busy_ = false;
+        if (!ok)
+          ++failures_;
+        wake_.notify_all();
+      }
+  }
+
+  mutable std::mutex      mutex_;
+  std::condition_variable wake_;
+  Checkpoint              back_;
+  Checkpoint              pending_;
+  std::string             pending_path_;
+  std::string             path_;
+  std::string             tmp_;
+  bool                    has_pending_;
+  bool                    busy_;
+  bool                    stop_;
+  unsigned                failures_;
+  std::thread             thread_;
+};
+
+#endif // GTKMM_EXAMPLE_CHECKPOINT_H
@@ -0,0 +1,385 @@
+#ifndef GTKMM_EXAMPLE_DOMAIN_H
+#define GTKMM_EXAMPLE_DOMAIN_H
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#include "./vec.h"
+#include "./particles.h"
+#include "./simulation.h"
+#include "./transport.h"
+
+/**
+   Domain decomposition of a simulation over the processes of a
+   distributed run, which talk through a Transport (transport.h).
+
+   The unit square is cut into as many strips along x as there are
+   ranks, all of the same width, and each rank owns the balls whose
+   x falls into its strip (the first and the last strip reach on past
+   the walls, for balls pushed beyond them). Each rank runs its own
+   Simulation on the balls it owns, followed by ghosts (see
+   Simulation::ghosts()). step() takes two rounds of messages:
+
+   1. Migration: the ghosts of the step before are dropped, and the
+      balls that have left the strip are sent to the rank they are in
+      now.
+
+   2. Halo and far field: each rank sends to each other rank copies
+      of its balls that are closer to the strip of that rank than the
+      halo width, which become ghosts there. With gravity, it also
+      sends a summary of the rest of its balls: one pseudo-ball (see
+      Simulation::far_field()) for each cell of a coarse mesh of
+      cells x cells over the unit square that holds any of them.
+
+   Then the Simulation takes a step. Gravity between the balls of a
+   strip and its ghosts is computed by the method of the simulation;
+   between strips, it goes through the pseudo-balls, like the cells
+   of a Barnes–Hut tree of a fixed size. A collision between a ball
+   and a ghost is resolved on both sides, and each side keeps what
+   happens to its own ball, so a contact across a boundary is found
+   by both ranks; Simulation::own_contacts() counts it as half on
+   each. Since the balls of the Simulation are replaced in each
+   step, the neighbor list and the gravity kept by velocity Verlet
+   don't carry over from one step to the next.
+
+   In each round, every rank sends one message to every other rank,
+   in size() - 1 exchanges: in exchange k, rank r sends to rank
+   r + k and receives from rank r - k (mod size()), so that every
+   rank sends and receives in every exchange.
+ */
+class Domain
+{
+public:
+  /**
+     Default halo width, in units of the largest radius, and number
+     of cells along a side of the mesh of the far field.
+   */
+  static constexpr double      default_halo  = 3.0;
+  static constexpr std::size_t default_cells = 16;
+
+  /**
+     Take over sim, which holds all balls of the run, as the domain of
+     this rank, keeping only the balls in its strip. The halo is given
+     in units of the largest radius.
+   */
+  Domain(Transport  &transport,
+         Simulation &sim,
+         double      halo  = default_halo,
+         std::size_t cells = default_cells)
+    : transport_(transport),
+      sim_(sim),
+      halo_(0.0),
+      cells_(std::max<std::size_t>(cells,1)),
+      out_(transport.size()),
+      in_(),
+      sums_(),
+      peer_sums_(),
+      far_(),
+      migrated_(0),
+      bytes_(0)
+  {
+    const Particles &balls = sim_.balls();
+    double max_rad = 0.0;
+    for (double rad : balls.rad)
+      max_rad = std::max(max_rad,rad);
+    halo_ = halo * max_rad;
+
+    Particles owned;
+    for (std::size_t i = 0 ; i < balls.size() ; ++i)
+      if (owner(balls.x[i]) == transport_.rank())
+        owned.push_back(ball(balls,i),balls.cold[i]);
+    sim_.balls(std::move(owned));
+  }
+
+  Domain(const Domain &) = delete;
+  Domain &operator=(const Domain &) = delete;
+
+  /**
+     One step of the whole run, advancing it by dt milliseconds.
+     Returns false if another rank has gone away.
+   */
+  bool step(double dt = Simulation::time_lapse)
+  {
+    const unsigned  me    = transport_.rank();
+    const Particles &balls = sim_.balls();
+    const std::size_t n   = balls.size() - sim_.ghosts();
+
+    /* 1. Migration. */
+    for (auto &out : out_)
+      out.clear();
+    Particles next;
+    next.reserve(n + n / 8);
+    for (std::size_t i = 0 ; i < n ; ++i)
+      {
+        const unsigned r = owner(balls.x[i]);
+        if (r == me)
+          next.push_back(ball(balls,i),balls.cold[i]);
+        else
+          {
+            put(out_[r],record(balls,i));
+            ++migrated_;
+          }
+      }
+    const bool moved = round([&next](const std::vector<char> &in) {
+        std::size_t pos = 0;
+        while (pos < in.size())
+          append(next,take<Record>(in,pos));
+      });
+    if (!moved)
+      return false;
+
+    /* 2. Halo and far field. The message to each rank starts with the
+       number of ghosts in it, which is only known at the end. */
+    const std::size_t owned   = next.size();
+    const bool        gravity = (sim_.gravity() != Simulation::Gravity::none);
+    for (auto &out : out_)
+      {
+        out.clear();
+        put(out,std::uint64_t(0));
+      }
+    if (gravity)
+      summarize(next);
+    for (std::size_t i = 0 ; i < owned ; ++i)
+      {
+        const unsigned first = owner(next.x[i] - halo_);
+        const unsigned last  = owner(next.x[i] + halo_);
+        for (unsigned r = first ; r <= last ; ++r)
+          if (r != me)
+            {
+              put(out_[r],record(next,i));
+              if (gravity)
+                remove(peer_sums_[r],next.x[i],next.y[i],next.m[i]);
+            }
+      }
+    for (unsigned r = 0 ; r < transport_.size() ; ++r)
+      if (r != me)
+        {
+          const std::uint64_t ghosts = (out_[r].size() - sizeof(std::uint64_t)) / sizeof(Record);
+          std::memcpy(out_[r].data(),&ghosts,sizeof(ghosts));
+          if (gravity)
+            for (const Sum &sum : peer_sums_[r])
+              if (sum.count > 0)
+                put(out_[r],Simulation::PseudoBall {
+                    { sum.mx / sum.m, sum.my / sum.m }, sum.m, sum.count });
+        }
+
+    far_.clear();
+    const bool halo = round([this,&next](const std::vector<char> &in) {
+        std::size_t pos = 0;
+        const std::uint64_t ghosts = take<std::uint64_t>(in,pos);
+        for (std::uint64_t g = 0 ; g < ghosts ; ++g)
+          append(next,take<Record>(in,pos));
+        while (pos < in.size())
+          far_.push_back(take<Simulation::PseudoBall>(in,pos));
+      });
+    if (!halo)
+      return false;
+
+    const std::size_t ghosts = next.size() - owned;
+    sim_.balls(std::move(next));
+    sim_.ghosts(ghosts);
+    sim_.far_field(far_);
+    sim_.step(dt);
+    return true;
+  }
+
+  /**
+     Add up values over all ranks. The sums arrive in rank 0; the
+     other ranks keep their own values. Returns false if another rank
+     has gone away.
+   */
+  bool sum(std::vector<double> &values)
+  {
+    if (transport_.rank() != 0)
+      {
+        std::vector<char> out(values.size() * sizeof(double));
+        std::memcpy(out.data(),values.data(),out.size());
+        return transport_.send(0,out);
+      }
+    for (unsigned r = 1 ; r < transport_.size() ; ++r)
+      {
+        if (!transport_.receive(r,in_) || in_.size() != values.size() * sizeof(double))
+          return false;
+        std::size_t pos = 0;
+        for (double &value : values)
+          value += take<double>(in_,pos);
+      }
+    return true;
+  }
+
+  /**
+     Number of balls this rank owns, without the ghosts.
+   */
+  std::size_t owned() const
+  { return sim_.balls().size() - sim_.ghosts(); }
+
+  /**
+     Number of balls this rank has sent to other ranks as they left
+     its strip, and number of bytes it has sent in all.
+   */
+  unsigned long migrated() const
+  { return migrated_; }
+
+  unsigned long bytes() const
+  { return bytes_; }
+
+  /**
+     Halo width, in units of the unit square.
+   */
+  double halo() const
+  { return halo_; }
+
+private:
+  /* A ball as it goes over the transport, between processes of the
+     same program, with the cold entry spelled out as in a checkpoint
+     (see checkpoint.h). */
+  struct Record
+  {
+    double        x;
+    double        y;
+    double        vx;
+    double        vy;
+    double        m;
+    double        rad;
+    double        color_r;
+    double        color_g;
+    double        color_b;
+    std::uint64_t id;
+    std::uint64_t recent_ball;
+    std::uint32_t recent_steps;
+    std::uint32_t calm;
+  };
+
+  /* Balls in a cell of the far field mesh: the sums of their mass
+     times position, mass and count. */
+  struct Sum
+  {
+    double mx;
+    double my;
+    double m;
+    double count;
+  };
+
+  template <class T>
+  static void put(std::vector<char> &buf, const T &value)
+  {
+    const std::size_t pos = buf.size();
+    buf.resize(pos + sizeof(T));
+    std::memcpy(buf.data() + pos,&value,sizeof(T));
+  }
+
+  template <class T>
+  static T take(const std::vector<char> &buf, std::size_t &pos)
+  {
+    T value;
+    std::memcpy(&value,buf.data() + pos,sizeof(T));
+    pos += sizeof(T);
+    return value;
+  }
+
+  static Ball ball(const Particles &balls, std::size_t i)
+  {
+    Ball b({ balls.x[i], balls.y[i] },{ balls.vx[i], balls.vy[i] },balls.m[i]);
+    b.rad = balls.rad[i];
+    return b;
+  }
+
+  static Record record(const Particles &balls, std::size_t i)
+  {
+    const Particles::Cold &c = balls.cold[i];
+    return { balls.x[i], balls.y[i], balls.vx[i], balls.vy[i], balls.m[i], balls.rad[i],
+             c.color_r, c.color_g, c.color_b, c.id,
+             c.recent_collision.first, c.recent_collision.second, c.calm };
+  }
+
+  static void append(Particles &balls, const Record &r)
+  {
+    Ball b({ r.x, r.y },{ r.vx, r.vy },r.m);
+    b.rad = r.rad;
+    balls.push_back(b,{ r.color_r, r.color_g, r.color_b, r.id,
+                        { r.recent_ball, r.recent_steps }, r.calm });
+  }
+
+  /* The rank whose strip holds x. */
+  unsigned owner(double x) const
+  {
+    const double   strip = std::floor(x * transport_.size());
+    const unsigned last  = transport_.size() - 1;
+    return (strip < 0 ? 0 : strip > last ? last : static_cast<unsigned>(strip));
+  }
+
+  std::size_t cell(double x, double y) const
+  {
+    auto index = [this](double v) {
+      const double c = std::floor(v * cells_);
+      return (c < 0 ? 0 : c >= cells_ ? cells_ - 1 : static_cast<std::size_t>(c));
+    };
+    return index(y) * cells_ + index(x);
+  }
+
+  void remove(std::vector<Sum> &sums, double x, double y, double m) const
+  {
+    Sum &sum = sums[cell(x,y)];
+    sum.mx    -= m * x;
+    sum.my    -= m * y;
+    sum.m     -= m;
+    sum.count -= 1;
+  }
+
+  /* The sums of the mesh over all owned balls, copied for each other
+     rank, from which the ghosts sent there are removed. */
+  void summarize(const Particles &balls)
+  {
+    sums_.assign(cells_ * cells_,Sum { 0.0, 0.0, 0.0, 0.0 });
+    for (std::size_t i = 0 ; i < balls.size() ; ++i)
+      {
+        Sum &sum = sums_[cell(balls.x[i],balls.y[i])];
+        sum.mx    += balls.m[i] * balls.x[i];
+        sum.my    += balls.m[i] * balls.y[i];
+        sum.m     += balls.m[i];
+        sum.count += 1;
+      }
+    peer_sums_.resize(transport_.size());
+    for (unsigned r = 0 ; r < transport_.size() ; ++r)
+      if (r != transport_.rank())
+        peer_sums_[r] = sums_;
+  }
+
+  /* Send out_[r] to each other rank r, and hand the message from
+     each to take. */
+  template <class Func>
+  bool round(Func &&take)
+  {
+    const unsigned size = transport_.size();
+    const unsigned me   = transport_.rank();
+    for (unsigned k = 1 ; k < size ; ++k)
+      {
+        const unsigned to   = (me + k) % size;
+        const unsigned from = (me + size - k) % size;
+        if (!transport_.exchange(to,out_[to],from,in_))
+          return false;
+        bytes_ += out_[to].size();
+        take(in_);
+      }
+    return true;
+  }
+
+  Transport                     &transport_;
+  Simulation                    &sim_;
+  double                         halo_;
+  std::size_t                    cells_;
+  std::vector<std::vector<char>> out_;
+  std::vector<char>              in_;
+  std::vector<Sum>               sums_;
+  std::vector<std::vector<Sum>>  peer_sums_;
+  std::vector<Simulation::PseudoBall> far_;
+  unsigned long                  migrated_;
+  unsigned long                  bytes_;
+};
+
+#endif // GTKMM_EXAMPLE_DOMAIN_H
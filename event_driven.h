@@ -0,0 +1,360 @@
+#ifndef GTKMM_EXAMPLE_EVENT_DRIVEN_H
+#define GTKMM_EXAMPLE_EVENT_DRIVEN_H
+
+#include <vector>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstddef>
+
+#include "./particles.h"
+
+/**
+   Event-driven alternative to the time-stepping integrator.
+
+   Instead of moving all balls by a fixed step and then repairing the
+   overlaps, this predicts the exact times at which the balls will hit
+   each other or a wall, keeps these events in a priority queue, and
+   jumps from one event to the next. Between events, the balls move in
+   straight lines, so nothing can tunnel, and nothing needs doing
+   while nothing happens.
+
+   To keep the predictions local, the unit square is divided into
+   cells at least as wide as the largest ball diameter, and no more
+   of them than there are balls, however small they are. A ball only
+   predicts collisions with the balls in the 3x3 cells around its own
+   cell; when it crosses into another cell (which is an event too), it
+   predicts against its new neighbors. For a dilute system this makes
+   the cost per event independent of the number of balls.
+
+   Events are invalidated lazily: each ball has a counter that goes up
+   whenever its velocity changes (or it changes cell), and an event
+   that was predicted with an older count is dropped when it comes up.
+
+   The balls don't feel any forces between events. If the simulation
+   changes the velocities from outside (e.g. by gravity), it must call
+   invalidate(), and the predictions are rebuilt at the next advance().
+
+   Each ball keeps its own clock: its position in Particles is the
+   one at time time_[i]. At the end of advance(), all balls are moved
+   to the end time.
+ */
+class EventDrivenEngine
+{
+public:
+  EventDrivenEngine()
+    : valid_(false),
+      now_(0.0),
+      dim_(1),
+      width_(1.0),
+      time_(),
+      count_(),
+      cell_(),
+      slot_(),
+      cells_(),
+      queue_(),
+      events_(0),
+      predictions_(0)
+  { }
+
+  /**
+     The velocities were changed from outside; rebuild all
+     predictions at the next advance().
+   */
+  void invalidate()
+  { valid_ = false; }
+
+  /**
+     Move the simulation forward by dt, processing all events on the
+     way. Returns the number of ball-ball collisions, and sets
+     ghost_ends to the number of balls from first_ghost on (the
+     ghosts, see Simulation::ghosts()) that took part in them.
+   */
+  std::size_t advance(Particles &balls, double dt,
+                      std::size_t first_ghost, std::size_t &ghost_ends)
+  {
+    /* Stale events pile up in the queue, so it is rebuilt from time
+       to time. */
+    if (!valid_ || time_.size() != balls.size()
+        || queue_.size() > 16 * balls.size() + 1024)
+      reset(balls);
+
+    const double end = now_ + dt;
+    std::size_t collisions = 0;
+    ghost_ends = 0;
+
+    while (!queue_.empty() && queue_.top().t <= end)
+      {
+        const Event e = queue_.top();
+        queue_.pop();
+
+        if (count_[e.a] != e.count_a)
+          continue;
+        if (e.kind == collision && count_[e.b] != e.count_b)
+          continue;
+
+        ++events_;
+        now_ = std::max(now_,e.t);
+        move(balls,e.a);
+
+        switch (e.kind)
+          {
+          case wall_x:
+            balls.vx[e.a] = -balls.vx[e.a];
+            ++count_[e.a];
+            predict(balls,e.a,false);
+            break;
+          case wall_y:
+            balls.vy[e.a] = -balls.vy[e.a];
+            ++count_[e.a];
+            predict(balls,e.a,false);
+            break;
+          case cell_x:
+          case cell_y:
+            change_cell(e.a,e.kind,(e.kind == cell_x ? balls.vx[e.a] : balls.vy[e.a]));
+            ++count_[e.a];
+            predict(balls,e.a,false);
+            break;
+          case collision:
+            move(balls,e.b);
+            resolve(balls,e.a,e.b);
+            ++count_[e.a];
+            ++count_[e.b];
+            predict(balls,e.a,false);
+            predict(balls,e.b,false);
+            ++collisions;
+            ghost_ends += (e.a >= first_ghost) + (e.b >= first_ghost);
+            break;
+          }
+      }
+
+    now_ = end;
+    for (std::size_t i = 0 ; i < balls.size() ; ++i)
+      move(balls,i);
+    return collisions;
+  }
+
+  /**
+     Number of events processed and of pair predictions made so far,
+     as a measure of the work done.
+   */
+  unsigned long events() const
+  { return events_; }
+
+  unsigned long predictions() const
+  { return predictions_; }
+
+private:
+  enum Kind : unsigned char { collision, wall_x, wall_y, cell_x, cell_y };
+
+  struct Event
+  {
+    double      t;
+    std::size_t a;
+    std::size_t b;
+    unsigned    count_a;
+    unsigned    count_b;
+    Kind        kind;
+
+    bool operator>(const Event &other) const
+    { return t > other.t; }
+  };
+
+  static constexpr double never()
+  { return std::numeric_limits<double>::infinity(); }
+
+  void reset(const Particles &balls)
+  {
+    const std::size_t n = balls.size();
+
+    double max_rad = 0.0;
+    for (double rad : balls.rad)
+      max_rad = std::max(max_rad,rad);
+    /* Each cell is a vector of its own, so with tiny balls the cells
+       are limited to about one per ball. */
+    dim_ = std::max<std::size_t>(1,static_cast<std::size_t>(std::sqrt(double(n))));
+    if (2 * max_rad * dim_ > 1.0)
+      dim_ = std::max<std::size_t>(1,static_cast<std::size_t>(1.0 / (2 * max_rad)));
+    width_ = 1.0 / dim_;
+
+    time_.assign(n,now_);
+    count_.assign(n,0);
+    cell_.resize(n);
+    slot_.resize(n);
+    cells_.resize(dim_ * dim_);
+    for (auto &cell : cells_)
+      cell.clear();
+    for (std::size_t i = 0 ; i < n ; ++i)
+      {
+        cell_[i] = coord(balls.y[i]) * dim_ + coord(balls.x[i]);
+        slot_[i] = cells_[cell_[i]].size();
+        cells_[cell_[i]].push_back(i);
+      }
+
+    queue_ = Queue();
+    for (std::size_t i = 0 ; i < n ; ++i)
+      predict(balls,i,true);
+    valid_ = true;
+  }
+
+  std::size_t coord(double v) const
+  {
+    if (!(v > 0))
+      return 0;
+    const std::size_t c = static_cast<std::size_t>(v * dim_);
+    return (c < dim_ ? c : dim_ - 1);
+  }
+
+  /* Bring ball i to the current time. */
+  void move(Particles &balls, std::size_t i)
+  {
+    const double dt = now_ - time_[i];
+    balls.x[i] += dt * balls.vx[i];
+    balls.y[i] += dt * balls.vy[i];
+    time_[i] = now_;
+  }
+
+  void push(double t, std::size_t a, std::size_t b, Kind kind)
+  {
+    if (t < never())
+      queue_.push({ now_ + std::max(t,0.0), a, b, count_[a],
+                    (kind == collision ? count_[b] : 0u), kind });
+  }
+
+  /* Time from now until ball i, at position x with velocity v and
+     radius r, hits one of the walls along one axis. */
+  static double wall_time(double x, double v, double r)
+  {
+    if (v > 0)
+      return (1.0 - r - x) / v;
+    if (v < 0)
+      return (r - x) / v;
+    return never();
+  }
+
+  /* Time from now until ball i leaves cell c along one axis. There is
+     no such event at the outermost cells, where the walls come
+     first. */
+  double cell_time(double x, double v, std::size_t c) const
+  {
+    if (v > 0 && c + 1 < dim_)
+      return ((c + 1) * width_ - x) / v;
+    if (v < 0 && c > 0)
+      return (c * width_ - x) / v;
+    return never();
+  }
+
+  /* Time from now until balls i and j touch, given that i has been
+     moved to the current time. Overlapping balls that approach each
+     other collide at once. */
+  double collision_time(const Particles &balls, std::size_t i, std::size_t j)
+  {
+    ++predictions_;
+    const double tj  = now_ - time_[j];
+    const double dx  = (balls.x[j] + tj * balls.vx[j]) - balls.x[i];
+    const double dy  = (balls.y[j] + tj * balls.vy[j]) - balls.y[i];
+    const double dvx = balls.vx[j] - balls.vx[i];
+    const double dvy = balls.vy[j] - balls.vy[i];
+
+    const double b = dx * dvx + dy * dvy;
+    if (b >= 0)
+      return never();
+
+    const double dvv   = dvx * dvx + dvy * dvy;
+    const double drr   = dx * dx + dy * dy;
+    const double sigma = balls.rad[i] + balls.rad[j];
+    if (drr < sigma * sigma)
+      return 0.0;
+
+    const double d = b * b - dvv * (drr - sigma * sigma);
+    if (d < 0)
+      return never();
+    return -(b + ::sqrt(d)) / dvv;
+  }
+
+  /* Predict all events of ball i, which is at the current time. When
+     all balls are predicted at once, each pair is only predicted from
+     the lower index. */
+  void predict(const Particles &balls, std::size_t i, bool lower_only)
+  {
+    const double x  = balls.x[i];
+    const double y  = balls.y[i];
+    const double vx = balls.vx[i];
+    const double vy = balls.vy[i];
+    const std::size_t cx = cell_[i] % dim_;
+    const std::size_t cy = cell_[i] / dim_;
+
+    push(wall_time(x,vx,balls.rad[i]),i,i,wall_x);
+    push(wall_time(y,vy,balls.rad[i]),i,i,wall_y);
+    push(cell_time(x,vx,cx),i,i,cell_x);
+    push(cell_time(y,vy,cy),i,i,cell_y);
+
+    const std::size_t x0 = (cx > 0 ? cx - 1 : 0);
+    const std::size_t y0 = (cy > 0 ? cy - 1 : 0);
+    const std::size_t x1 = std::min(cx + 1,dim_ - 1);
+    const std::size_t y1 = std::min(cy + 1,dim_ - 1);
+    for (std::size_t yy = y0 ; yy <= y1 ; ++yy)
+      for (std::size_t xx = x0 ; xx <= x1 ; ++xx)
+        for (std::size_t j : cells_[yy * dim_ + xx])
+          if (j != i && (!lower_only || j > i))
+            push(collision_time(balls,i,j),i,j,collision);
+  }
+
+  void change_cell(std::size_t i, Kind kind, double v)
+  {
+    /* Remove i from its cell by moving the last ball of the cell
+       into its slot. */
+    auto &old_cell = cells_[cell_[i]];
+    const std::size_t last = old_cell.back();
+    old_cell[slot_[i]] = last;
+    slot_[last] = slot_[i];
+    old_cell.pop_back();
+
+    const std::size_t step = (kind == cell_x ? 1 : dim_);
+    cell_[i] = (v > 0 ? cell_[i] + step : cell_[i] - step);
+    slot_[i] = cells_[cell_[i]].size();
+    cells_[cell_[i]].push_back(i);
+  }
+
+  /* Elastic collision of two balls that touch: exchange momentum
+     along the line between their centers. */
+  static void resolve(Particles &balls, std::size_t i, std::size_t j)
+  {
+    const double dx   = balls.x[j] - balls.x[i];
+    const double dy   = balls.y[j] - balls.y[i];
+    const double dist = ::sqrt(dx * dx + dy * dy);
+    if (!(dist > 0))
+      return;
+    const double nx = dx / dist;
+    const double ny = dy / dist;
+
+    const double vn = (balls.vx[j] - balls.vx[i]) * nx + (balls.vy[j] - balls.vy[i]) * ny;
+    const double mi = balls.m[i];
+    const double mj = balls.m[j];
+    const double J  = 2 * mi * mj * vn / (mi + mj);
+
+    balls.vx[i] += (J / mi) * nx;
+    balls.vy[i] += (J / mi) * ny;
+    balls.vx[j] -= (J / mj) * nx;
+    balls.vy[j] -= (J / mj) * ny;
+  }
+
+  using Queue = std::priority_queue<Event,std::vector<Event>,std::greater<Event>>;
+
+  bool                                  valid_;
+  double                                now_;
+  std::size_t                           dim_;
+  double                                width_;
+  std::vector<double>                   time_;
+  std::vector<unsigned>                 count_;
+  std::vector<std::size_t>              cell_;
+  std::vector<std::size_t>              slot_;
+  std::vector<std::vector<std::size_t>> cells_;
+  Queue                                 queue_;
+  unsigned long                         events_;
+  unsigned long                         predictions_;
+};
+
+#endif // GTKMM_EXAMPLE_EVENT_DRIVEN_H
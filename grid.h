@@ -0,0 +1,141 @@
+#ifndef GTKMM_EXAMPLE_GRID_H
+#define GTKMM_EXAMPLE_GRID_H
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cmath>
+
+#include "./vec.h"
+
+/**
+   A uniform grid over the unit square [0,1]², used as the broad
+   phase of the collision detection.
+
+   Use as follows:
+
+   Call build() once per simulation step, passing the number of
+   balls, the minimum width of a cell (twice the largest radius of
+   any ball, so that two balls can only touch if they are in the same
+   or in adjacent cells) and a function that returns the position of
+   ball number i.
+
+   Then, for each ball i, call foreach_neighbor(i,func) to have func
+   called on the index of every ball in the 3x3 block of cells around
+   the cell of i (including i itself).
+
+   The grid stores indices only, so it does not care how the balls
+   themselves are stored. The cells are built by a counting sort, so
+   the order of the balls within each cell is the order of their
+   indices.
+ */
+class UniformGrid
+{
+public:
+  /**
+     Upper limit to the number of cells along one side. This keeps
+     the memory use bounded if all the balls are tiny.
+   */
+  static constexpr std::size_t max_dim = 1024;
+
+  UniformGrid()
+    : dim_(1),
+      cell_start_(),
+      cell_of_(),
+      items_()
+  { }
+
+  template <class PosFunc>
+  void build(std::size_t n, double min_cell_width, PosFunc &&pos)
+  {
+    using std::size_t;
+
+    dim_ = max_dim;
+    if (min_cell_width * max_dim > 1.0)
+      dim_ = std::max<size_t>(1,static_cast<size_t>(1.0 / min_cell_width));
+
+    cell_start_.assign(dim_ * dim_ + 1,0);
+    cell_of_.resize(n);
+    items_.resize(n);
+
+    for (size_t i = 0 ; i < n ; ++i)
+      {
+        const Vec2d p = pos(i);
+        const size_t c = cell_index(coord(p.x),coord(p.y));
+        cell_of_[i] = c;
+        ++cell_start_[c+1];
+      }
+    for (size_t c = 0 ; c < dim_ * dim_ ; ++c)
+      cell_start_[c+1] += cell_start_[c];
+
+    /* The fill pointers are taken from the start offsets and moved
+       back into place afterwards. */
+    for (size_t i = 0 ; i < n ; ++i)
+      items_[cell_start_[cell_of_[i]]++] = i;
+    for (size_t c = dim_ * dim_ ; c > 0 ; --c)
+      cell_start_[c] = cell_start_[c-1];
+    cell_start_[0] = 0;
+  }
+
+  /**
+     Call func(j) for each ball j in the cell of ball i or in any of
+     the (up to) eight cells around it.
+   */
+  template <class Func>
+  void foreach_neighbor(std::size_t i, Func &&func) const
+  {
+    using std::size_t;
+
+    const size_t cx = cell_of_[i] % dim_;
+    const size_t cy = cell_of_[i] / dim_;
+    const size_t x0 = (cx > 0 ? cx - 1 : 0);
+    const size_t y0 = (cy > 0 ? cy - 1 : 0);
+    const size_t x1 = std::min(cx + 1,dim_ - 1);
+    const size_t y1 = std::min(cy + 1,dim_ - 1);
+
+    for (size_t y = y0 ; y <= y1 ; ++y)
+      {
+        const size_t *it  = items_.data() + cell_start_[cell_index(x0,y)];
+        const size_t *end = items_.data() + cell_start_[cell_index(x1,y) + 1];
+        for ( ; it != end ; ++it)
+          func(*it);
+      }
+  }
+
+  /**
+     Call func(i) for each ball i in cell (x,y), in the order of their
+     indices.
+   */
+  template <class Func>
+  void foreach_in_cell(std::size_t x, std::size_t y, Func &&func) const
+  {
+    const std::size_t c = cell_index(x,y);
+    for (std::size_t k = cell_start_[c] ; k < cell_start_[c+1] ; ++k)
+      func(items_[k]);
+  }
+
+  std::size_t dim() const
+  { return dim_; }
+
+  std::size_t cell_of(std::size_t i) const
+  { return cell_of_[i]; }
+
+private:
+  std::size_t coord(double v) const
+  {
+    if (!(v > 0))
+      return 0;
+    const std::size_t c = static_cast<std::size_t>(v * dim_);
+    return (c < dim_ ? c : dim_ - 1);
+  }
+
+  std::size_t cell_index(std::size_t x, std::size_t y) const
+  { return y * dim_ + x; }
+
+  std::size_t              dim_;
+  std::vector<std::size_t> cell_start_;
+  std::vector<std::size_t> cell_of_;
+  std::vector<std::size_t> items_;
+};
+
+#endif // GTKMM_EXAMPLE_GRID_H
@@ -0,0 +1,501 @@
+/*
+  Runs the simulation without a display, as fast as possible, and
+  prints the number of steps per second.
+
+  Build as:
+
+  g++ -O3 -W -Wall -Wno-parentheses -std=c++1y -pthread -o simul-headless headless.cpp kernels.cpp
+
+  With -DSIMUL_CHECK_ALLOC, the global operator new counts its calls,
+  and --check-alloc N makes the run fail if any step after the first
+  N calls it.
+
+  With --ranks N, the run is split over N processes (see domain.h),
+  which rank 0 forks at the start and which talk over Unix-domain
+  sockets (see transport.h). Rank 0 prints the totals.
+*/
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <utility>
+#include <memory>
+#include <new>
+#include <atomic>
+#include <cmath>
+#include <algorithm>
+
+#include "./simulation.h"
+#include "./trajectory.h"
+#include "./transport.h"
+#include "./domain.h"
+
+#ifdef SIMUL_CHECK_ALLOC
+#include "./check_alloc.h"
+#endif
+
+namespace {
+
+void usage(const char *prog)
+{
+  std::cerr
+    << "Usage: " << prog << " [options]\n"
+    << "  --seed N          random seed (default 23)\n"
+    << "  --balls N         number of random balls (default 100)\n"
+    << "  --steps N         number of steps to run (default 1000)\n"
+    << "  --threads N       number of threads (default: all cores, shared\n"
+    << "                    by the ranks)\n"
+    << "  --ranks N         split the run over N processes (default 1)\n"
+    << "  --halo X          width of the halo of ghosts of a rank, in units\n"
+    << "                    of the largest radius (default " << Domain::default_halo << ")\n"
+    << "  --far-cells N     cells along a side of the mesh of the far field\n"
+    << "                    between ranks (default " << Domain::default_cells << ")\n"
+    << "  --broad-phase P   all-pairs | grid | list (default grid; list\n"
+    << "                    is only faster with --gravity none)\n"
+    << "  --skin X          skin of the neighbor list, in units of the\n"
+    << "                    largest radius (default " << Simulation::default_skin << ")\n"
+    << "  --gravity G       pairwise | barnes-hut | mesh | cutoff | none\n"
+    << "                    (default pairwise; cutoff is the mesh plus the\n"
+    << "                    exact pull within --cutoff)\n"
+    << "  --theta X         opening angle of Barnes-Hut (default 0.5)\n"
+    << "  --mesh N          cells along a side of the particle mesh\n"
+    << "                    (default " << ParticleMesh::default_size << ")\n"
+    << "  --cutoff C        range of the exact pull of --gravity cutoff, in\n"
+    << "                    cells of the mesh (default " << Simulation::default_cutoff_cells << ")\n"
+    << "  --kernels K       scalar | sse2 | avx2 | best (default best)\n"
+    << "  --integrator I    stepping | event-driven (default stepping)\n"
+    << "  --scheme S        euler | verlet | rk4, for stepping (default euler)\n"
+    << "  --dt MS           length of a step in ms (default " << Simulation::time_lapse << ")\n"
+    << "  --adaptive C      cut steps into substeps in which no ball moves\n"
+    << "                    further than C times the smallest radius\n"
+    << "  --energy N        measure the energy drift every N steps\n"
+    << "  --sleep K         stop balls that have been slower than the sleep\n"
+    << "                    speed for K steps, until they are hit\n"
+    << "  --sleep-speed V   sleep speed in units per ms (default 1e-5)\n"
+    << "  --sort N          sort the balls spatially every N steps, 0 for\n"
+    << "                    never (default " << Simulation::default_sort_interval << ")\n"
+    << "  --restore FILE    start from a checkpoint instead of random balls\n"
+    << "  --checkpoint FILE write a checkpoint at the end\n"
+    << "  --every N         and also every N steps, in the background\n"
+    << "  --record FILE     record the positions of every step\n"
+    << "  --trace FILE      write the timings of each step as CSV\n"
+    << "                    (needs a build with -DSIMUL_PROFILE)\n"
+    << "  --check-alloc N   fail if a step after the first N allocates\n"
+    << "                    (needs a build with -DSIMUL_CHECK_ALLOC)\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  using BroadPhase = Simulation::BroadPhase;
+  using Gravity    = Simulation::Gravity;
+  using Integrator = Simulation::Integrator;
+  using Scheme     = Simulation::Scheme;
+
+  Simulation::seed_type seed        = 23;
+  std::size_t           n_balls     = 100;
+  unsigned long         steps       = 1000;
+  unsigned              threads     = 0;
+  unsigned              ranks       = 1;
+  double                halo        = Domain::default_halo;
+  std::size_t           far_cells   = Domain::default_cells;
+  BroadPhase            broad_phase = BroadPhase::uniform_grid;
+  Gravity               gravity     = Gravity::pairwise;
+  double                theta       = 0.5;
+  double                skin        = Simulation::default_skin;
+  std::size_t           mesh        = ParticleMesh::default_size;
+  double                cutoff      = Simulation::default_cutoff_cells;
+  const Kernels        *kernels     = &best_kernels();
+  Integrator            integrator  = Integrator::time_stepping;
+  Scheme                scheme      = Scheme::euler;
+  double                dt          = Simulation::time_lapse;
+  double                courant     = 0.0;
+  unsigned long         energy      = 0;
+  unsigned              sleep       = 0;
+  double                sleep_speed = 1e-5;
+  std::string           trace;
+  std::string           restore;
+  std::string           record;
+  std::string           checkpoint;
+  unsigned long         every       = 0;
+  unsigned              sort        = Simulation::default_sort_interval;
+  long                  check_alloc = -1;
+
+  for (int a = 1 ; a < argc ; ++a)
+    {
+      const std::string opt = argv[a];
+      if (opt == "--help" || opt == "-h")
+        {
+          usage(argv[0]);
+          return 0;
+        }
+      if (a + 1 == argc)
+        {
+          usage(argv[0]);
+          return 1;
+        }
+      const std::string val = argv[++a];
+
+      if (opt == "--seed")
+        seed = std::strtoul(val.c_str(),nullptr,10);
+      else if (opt == "--balls")
+        n_balls = std::strtoul(val.c_str(),nullptr,10);
+      else if (opt == "--steps")
+        steps = std::strtoul(val.c_str(),nullptr,10);
+      else if (opt == "--threads")
+        threads = std::strtoul(val.c_str(),nullptr,10);
+      else if (opt == "--ranks")
+        ranks = std::strtoul(val.c_str(),nullptr,10);
+      else if (opt == "--halo")
+        halo = std::strtod(val.c_str(),nullptr);
+      else if (opt == "--far-cells")
+        far_cells = std::strtoul(val.c_str(),nullptr,10);
+      else if (opt == "--restore")
+        restore = val;
+      else if (opt == "--checkpoint")
+        checkpoint = val;
+      else if (opt == "--sort")
+        sort = std::strtoul(val.c_str(),nullptr,10);
+      else if (opt == "--every")
+        every = std::strtoul(val.c_str(),nullptr,10);
+      else if (opt == "--record")
+        record = val;
+      else if (opt == "--trace")
+        trace = val;
+      else if (opt == "--check-alloc")
+        check_alloc = std::strtol(val.c_str(),nullptr,10);
+      else if (opt == "--skin")
+        skin = std::strtod(val.c_str(),nullptr);
+      else if (opt == "--theta")
+        theta = std::strtod(val.c_str(),nullptr);
+      else if (opt == "--mesh")
+        mesh = std::strtoul(val.c_str(),nullptr,10);
+      else if (opt == "--cutoff")
+        cutoff = std::strtod(val.c_str(),nullptr);
+      else if (opt == "--dt")
+        dt = std::strtod(val.c_str(),nullptr);
+      else if (opt == "--adaptive")
+        courant = std::strtod(val.c_str(),nullptr);
+      else if (opt == "--energy")
+        energy = std::strtoul(val.c_str(),nullptr,10);
+      else if (opt == "--sleep")
+        sleep = std::strtoul(val.c_str(),nullptr,10);
+      else if (opt == "--sleep-speed")
+        sleep_speed = std::strtod(val.c_str(),nullptr);
+      else if (opt == "--broad-phase" && val == "all-pairs")
+        broad_phase = BroadPhase::all_pairs;
+      else if (opt == "--broad-phase" && val == "grid")
+        broad_phase = BroadPhase::uniform_grid;
+      else if (opt == "--broad-phase" && val == "list")
+        broad_phase = BroadPhase::neighbor_list;
+      else if (opt == "--gravity" && val == "pairwise")
+        gravity = Gravity::pairwise;
+      else if (opt == "--gravity" && val == "barnes-hut")
+        gravity = Gravity::barnes_hut;
+      else if (opt == "--gravity" && val == "mesh")
+        gravity = Gravity::particle_mesh;
+      else if (opt == "--gravity" && val == "cutoff")
+        gravity = Gravity::cutoff;
+      else if (opt == "--gravity" && val == "none")
+        gravity = Gravity::none;
+      else if (opt == "--integrator" && val == "stepping")
+        integrator = Integrator::time_stepping;
+      else if (opt == "--integrator" && val == "event-driven")
+        integrator = Integrator::event_driven;
+      else if (opt == "--scheme" && val == "euler")
+        scheme = Scheme::euler;
+      else if (opt == "--scheme" && val == "verlet")
+        scheme = Scheme::verlet;
+      else if (opt == "--scheme" && val == "rk4")
+        scheme = Scheme::rk4;
+      else if (opt == "--kernels" && val == "scalar")
+        kernels = &scalar_kernels();
+      else if (opt == "--kernels" && val == "sse2")
+        kernels = &sse2_kernels();
+      else if (opt == "--kernels" && val == "avx2")
+        kernels = &avx2_kernels();
+      else if (opt == "--kernels" && val == "best")
+        kernels = &best_kernels();
+      else
+        {
+          usage(argv[0]);
+          return 1;
+        }
+    }
+
+  if (!kernels_supported(*kernels))
+    {
+      std::cerr << "The " << kernels->name << " kernels are not supported on this CPU.\n";
+      return 1;
+    }
+
+  if (ranks == 0)
+    ranks = 1;
+  if (threads == 0)
+    threads = std::max(1u,std::thread::hardware_concurrency() / ranks);
+  if (ranks > 1 && (!restore.empty() || !checkpoint.empty() || !record.empty()
+                    || energy > 0 || sleep > 0 || check_alloc >= 0))
+    {
+      std::cerr << "--ranks doesn't go with --restore, --checkpoint, --record, "
+                << "--energy, --sleep or --check-alloc.\n";
+      return 1;
+    }
+
+  /* The other ranks are forked before any threads are started, and
+     continue from here. */
+  std::unique_ptr<SocketTransport> transport;
+  if (ranks > 1)
+    {
+      transport = SocketTransport::spawn(ranks);
+      if (!transport)
+        {
+          std::cerr << "Cannot start " << ranks << " processes.\n";
+          return 1;
+        }
+    }
+
+  Simulation sim(seed,(restore.empty() ? n_balls : 0),broad_phase,gravity,theta);
+  std::unique_ptr<Domain> domain;
+  if (transport)
+    domain.reset(new Domain(*transport,sim,halo,far_cells));
+  if (!restore.empty())
+    {
+      Checkpoint state;
+      const auto start = std::chrono::steady_clock::now();
+      if (!read_checkpoint(restore,state))
+        {
+          std::cerr << "Cannot read the checkpoint " << restore << ".\n";
+          return 1;
+        }
+      sim.restore(std::move(state));
+      std::cout << "restored:   " << sim.balls().size() << " balls at step "
+                << sim.steps() << " in "
+                << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+                << " s\n";
+    }
+  sim.threads(threads);
+  sim.mesh_size(mesh);
+  sim.cutoff_cells(cutoff);
+  sim.neighbor_skin(skin);
+  sim.kernels(*kernels);
+  sim.integrator(integrator);
+  sim.scheme(scheme);
+  sim.adaptive(courant);
+  sim.sleep(sleep_speed,sleep);
+  sim.sort_interval(sort);
+  if (!trace.empty())
+    {
+#ifdef SIMUL_PROFILE
+      if (!sim.profiler().trace(trace))
+        {
+          std::cerr << "Cannot write " << trace << ".\n";
+          return 1;
+        }
+#else
+      std::cerr << "--trace needs a build with -DSIMUL_PROFILE.\n";
+      return 1;
+#endif
+    }
+#ifndef SIMUL_CHECK_ALLOC
+  if (check_alloc >= 0)
+    {
+      std::cerr << "--check-alloc needs a build with -DSIMUL_CHECK_ALLOC.\n";
+      return 1;
+    }
+#endif
+
+  CheckpointWriter writer;
+  std::unique_ptr<TrajectoryWriter> recorder;
+  if (!record.empty())
+    {
+      recorder.reset(new TrajectoryWriter(record,sim.balls()));
+      if (!recorder->good())
+        {
+          std::cerr << "Cannot write " << record << ".\n";
+          return 1;
+        }
+      recorder->record(sim.balls(),sim.steps());
+    }
+
+  /* The energy is measured outside of the timed steps. */
+  double energy_start = 0.0;
+  double max_drift    = 0.0;
+  double energy_secs  = 0.0;
+  auto drift = [&]() {
+    const auto start = std::chrono::steady_clock::now();
+    const double e = sim.energy().total();
+    energy_secs += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    max_drift = std::max(max_drift,(energy_start != 0 ? std::abs(e / energy_start - 1) : 0.0));
+    return e;
+  };
+  if (energy > 0)
+    energy_start = sim.energy().total();
+
+  using clock = std::chrono::steady_clock;
+  std::size_t   contacts = 0;
+  double        own_contacts = 0.0;
+  unsigned long substeps = 0;
+  const auto start = clock::now();
+  for (unsigned long s = 0 ; s < steps ; ++s)
+    {
+      if (domain)
+        {
+          if (!domain->step(dt))
+            {
+              std::cerr << "Rank " << transport->rank() << " lost its peers at step "
+                        << sim.steps() << ".\n";
+              return 1;
+            }
+        }
+      else
+        {
+#ifdef SIMUL_CHECK_ALLOC
+          const unsigned long before = check_alloc::allocations.load();
+          sim.step(dt);
+          const unsigned long during = check_alloc::allocations.load() - before;
+          if (check_alloc >= 0 && s >= static_cast<unsigned long>(check_alloc) && during > 0)
+            {
+              std::cerr << "Step " << sim.steps() << " allocated memory " << during
+                        << " times after a warm-up of " << check_alloc << " steps.\n";
+              return 1;
+            }
+#else
+          sim.step(dt);
+#endif
+        }
+      contacts += sim.contacts();
+      own_contacts += sim.own_contacts();
+      substeps += sim.last_substeps();
+      if (energy > 0 && (s + 1) % energy == 0)
+        drift();
+      if (recorder)
+        recorder->record(sim.balls(),sim.steps());
+      if (!checkpoint.empty() && every > 0 && (s + 1) % every == 0)
+        {
+          sim.save(writer.back());
+          writer.save(checkpoint);
+        }
+    }
+  const double secs = std::chrono::duration<double>(clock::now() - start).count()
+    - energy_secs;
+
+  if (domain)
+    {
+      std::vector<double> totals = {
+        double(domain->owned()), own_contacts, double(domain->migrated()),
+        double(sim.ghosts()), double(domain->bytes())
+      };
+      if (!domain->sum(totals))
+        {
+          std::cerr << "Rank " << transport->rank() << " lost its peers at the end.\n";
+          return 1;
+        }
+      if (transport->rank() != 0)
+        return 0;
+      /* The contacts with ghosts count as halves (see own_contacts()),
+         so the totals are whole numbers up to rounding. */
+      auto total = [&totals](std::size_t k) {
+        return static_cast<unsigned long long>(std::llround(totals[k]));
+      };
+      if (!transport->join())
+        {
+          std::cerr << "A rank failed.\n";
+          return 1;
+        }
+      std::cout << "ranks:      " << ranks << '\n'
+                << "balls:      " << total(0) << '\n'
+                << "steps:      " << steps << '\n'
+                << "threads:    " << sim.threads() << " per rank\n"
+                << "kernels:    " << sim.kernels().name << '\n'
+                << "contacts:   " << total(1) << '\n'
+                << "migrated:   " << total(2) << '\n'
+                << "ghosts:     " << total(3) << " (halo " << domain->halo() << ")\n"
+                << "sent:       " << total(4) / std::max(steps,1ul) << " bytes per step\n"
+                << "seconds:    " << secs << '\n'
+                << "steps/sec:  " << (secs > 0 ? steps / secs : 0.0) << '\n'
+                << "sim speed:  " << (secs > 0 ? steps * dt / 1000 / secs : 0.0)
+                << " simulated seconds per second\n";
+      return 0;
+    }
+
+  if (recorder)
+    {
+      if (!recorder->close())
+        {
+          std::cerr << "Cannot write " << record << ".\n";
+          return 1;
+        }
+      if (recorder->rejected() > 0)
+        {
+          std::cerr << "Left " << recorder->rejected() << " frames out of " << record
+                    << ", whose balls didn't match the first.\n";
+          return 1;
+        }
+      std::cout << "recorded:   " << recorder->frames() << " frames, "
+                << recorder->bytes() << " bytes ("
+                << double(recorder->bytes()) / recorder->frames() / sim.balls().size()
+                << " per ball and frame), " << recorder->stalls() << " stalls\n";
+    }
+
+  if (!checkpoint.empty())
+    {
+      sim.save(writer.back());
+      writer.save(checkpoint);
+      writer.wait();
+      if (writer.failures() > 0)
+        {
+          std::cerr << "Cannot write the checkpoint " << checkpoint << ".\n";
+          return 1;
+        }
+    }
+
+  std::cout << "balls:      " << sim.balls().size() << '\n'
+            << "steps:      " << steps << '\n'
+            << "threads:    " << sim.threads() << '\n'
+            << "kernels:    " << sim.kernels().name << '\n'
+            << "contacts:   " << contacts << '\n';
+  if (sim.approximate())
+    std::cout << "grav error: " << sim.gravity_error() << '\n';
+  if (integrator == Integrator::event_driven)
+    std::cout << "events:     " << sim.event_engine().events() << '\n'
+              << "pair tests: " << sim.event_engine().predictions() << '\n';
+  if (broad_phase == BroadPhase::neighbor_list)
+    std::cout << "list:       " << sim.neighbor_list().builds() << " builds, "
+              << sim.neighbor_list().size() << " pairs\n";
+  if (sleep > 0)
+    std::cout << "awake:      " << sim.awake() << '\n';
+  if (courant > 0)
+    std::cout << "substeps:   " << double(substeps) / std::max(steps,1ul) << " per step\n";
+  if (energy > 0)
+    {
+      const double last = drift();
+      std::cout << "energy:     " << energy_start << " -> " << last << '\n'
+                << "drift:      " << (energy_start != 0 ? std::abs(last / energy_start - 1) : 0.0)
+                << " (max " << max_drift << ")\n";
+    }
+  std::cout << "seconds:    " << secs << '\n'
+            << "steps/sec:  " << (secs > 0 ? steps / secs : 0.0) << '\n'
+            << "sim speed:  " << (secs > 0 ? steps * dt / 1000 / secs : 0.0)
+            << " simulated seconds per second\n";
+
+  SIMUL_PROFILE_ONLY(
+    std::cout << "last " << Profiler::window << " steps, mean / p99:\n";
+    for (std::size_t p = 0 ; p < Profiler::draw ; ++p)
+      {
+        const auto stats = sim.profiler().stats(Profiler::Phase(p));
+        std::cout << "  " << Profiler::name(Profiler::Phase(p)) << ": "
+                  << stats.mean << " / " << stats.p99 << " us\n";
+      }
+    for (std::size_t c = 0 ; c < Profiler::counters ; ++c)
+      {
+        const auto stats = sim.profiler().stats(Profiler::Counter(c));
+        std::cout << "  " << Profiler::name(Profiler::Counter(c)) << ": "
+                  << stats.mean << " / " << stats.p99 << '\n';
+      }
+  )
+
+  return 0;
+}
@@ -0,0 +1,382 @@
+/* The vector kernels must not differ from the scalar ones by
+   rounding, so the compiler may not contract a * b + c into a fused
+   multiply-add anywhere in this file (GCC does so by default when
+   FMA is enabled, e.g. with -march=native). */
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+#include "kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMUL_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+/* Scalar kernels. */
+
+template <class T>
+void integrate_scalar(T *x, const T *v, std::size_t n, T dt)
+{
+  for (std::size_t i = 0 ; i < n ; ++i)
+    x[i] += dt * v[i];
+}
+
+template <class T>
+inline void wall_scalar(T &x, T &v, T rad, T eps)
+{
+  if (x - rad < 0)
+    {
+      x = rad + eps;
+      v = -v;
+    }
+  if (x + rad > T(1))
+    {
+      x = T(1) - rad - eps;
+      v = -v;
+    }
+}
+
+template <class T>
+void walls_scalar(T *x, T *v, const T *rad, std::size_t n, T eps)
+{
+  for (std::size_t i = 0 ; i < n ; ++i)
+    wall_scalar(x[i],v[i],rad[i],eps);
+}
+
+/* The gravity kernels keep L partial sums per coordinate. Lane k
+   gets the terms of the balls j with j % L == k; the balls left over
+   after the last full block of L are added by gravity_tail(), in the
+   same way by all kernels. */
+
+template <class T, std::size_t N>
+inline void gravity_term(const T *const p[N], const T *m,
+                         std::size_t i, std::size_t j, T G, T *a[N], std::size_t lane)
+{
+  T d[N];
+  for (std::size_t k = 0 ; k < N ; ++k)
+    d[k] = p[k][i] - p[k][j];
+  T r2 = d[0] * d[0];
+  for (std::size_t k = 1 ; k < N ; ++k)
+    r2 += d[k] * d[k];
+  const T s = (r2 > 0 ? G * ((m[i] + m[j]) / r2) : T(0));
+  for (std::size_t k = 0 ; k < N ; ++k)
+    a[k][lane] += s * d[k];
+}
+
+/* The sum of the L lanes, added up pairwise. */
+template <class T, std::size_t L>
+struct LaneSum
+{
+  static T of(const T *a)
+  { return LaneSum<T,L/2>::of(a) + LaneSum<T,L/2>::of(a + L/2); }
+};
+
+template <class T>
+struct LaneSum<T,1>
+{
+  static T of(const T *a)
+  { return a[0]; }
+};
+
+template <class T, std::size_t N>
+inline void gravity_tail(const T *const p[N], const T *m,
+                         std::size_t n, std::size_t i, T G,
+                         T *a[N], T *const dv[N], std::size_t out)
+{
+  constexpr std::size_t L = KernelSet<T,N>::gravity_lanes;
+  for (std::size_t j = n & ~(L - 1) ; j < n ; ++j)
+    gravity_term<T,N>(p,m,i,j,G,a,j & (L - 1));
+  for (std::size_t k = 0 ; k < N ; ++k)
+    dv[k][out] = LaneSum<T,L>::of(a[k]);
+}
+
+template <class T, std::size_t N>
+void gravity_scalar(const T *const p[N], const T *m,
+                    std::size_t n, std::size_t begin, std::size_t end,
+                    T G, T *const dv[N])
+{
+  constexpr std::size_t L = KernelSet<T,N>::gravity_lanes;
+  for (std::size_t i = begin ; i < end ; ++i)
+    {
+      T sums[N][L] = {};
+      T *a[N];
+      for (std::size_t k = 0 ; k < N ; ++k)
+        a[k] = sums[k];
+      for (std::size_t j = 0 ; j + L <= n ; j += L)
+        for (std::size_t h = 0 ; h < L ; ++h)
+          gravity_term<T,N>(p,m,i,j+h,G,a,h);
+      gravity_tail<T,N>(p,m,n,i,G,a,dv,i - begin);
+    }
+}
+
+#ifdef SIMUL_X86
+
+/* The vector kernels are written once against a set of wrappers of
+   the intrinsics, one per instruction set and number type. */
+
+#define SIMUL_SIMD(target_name,type,reg,count,suffix,prefix)              \
+  struct target_name##_##type                                             \
+  {                                                                       \
+    using T = type;                                                       \
+    using R = reg;                                                        \
+    static constexpr std::size_t lanes = count;                           \
+    __attribute__((target(#target_name)))                                 \
+    static R set1(T v)             { return prefix##_set1_##suffix(v); }  \
+    __attribute__((target(#target_name)))                                 \
+    static R zero()                { return prefix##_setzero_##suffix(); }\
+    __attribute__((target(#target_name)))                                 \
+    static R load(const T *p)      { return prefix##_loadu_##suffix(p); } \
+    __attribute__((target(#target_name)))                                 \
+    static void store(T *p, R a)   { prefix##_storeu_##suffix(p,a); }     \
+    __attribute__((target(#target_name)))                                 \
+    static R add(R a, R b)         { return prefix##_add_##suffix(a,b); } \
+    __attribute__((target(#target_name)))                                 \
+    static R sub(R a, R b)         { return prefix##_sub_##suffix(a,b); } \
+    __attribute__((target(#target_name)))                                 \
+    static R mul(R a, R b)         { return prefix##_mul_##suffix(a,b); } \
+    __attribute__((target(#target_name)))                                 \
+    static R div(R a, R b)         { return prefix##_div_##suffix(a,b); } \
+    __attribute__((target(#target_name)))                                 \
+    static R bit_and(R a, R b)     { return prefix##_and_##suffix(a,b); } \
+    __attribute__((target(#target_name)))                                 \
+    static R bit_xor(R a, R b)     { return prefix##_xor_##suffix(a,b); } \
+    SIMUL_SIMD_COMPARE_##target_name(R,suffix,prefix)                     \
+  }
+
+#define SIMUL_SIMD_COMPARE_sse2(R,suffix,prefix)                          \
+  __attribute__((target("sse2")))                                         \
+  static R less(R a, R b)        { return prefix##_cmplt_##suffix(a,b); } \
+  __attribute__((target("sse2")))                                         \
+  static R greater(R a, R b)     { return prefix##_cmpgt_##suffix(a,b); } \
+  __attribute__((target("sse2")))                                         \
+  static R blend(R a, R b, R mask)                                        \
+  { return prefix##_or_##suffix(prefix##_andnot_##suffix(mask,a),         \
+                                prefix##_and_##suffix(mask,b)); }
+
+#define SIMUL_SIMD_COMPARE_avx2(R,suffix,prefix)                          \
+  __attribute__((target("avx2")))                                         \
+  static R less(R a, R b)        { return prefix##_cmp_##suffix(a,b,_CMP_LT_OQ); } \
+  __attribute__((target("avx2")))                                         \
+  static R greater(R a, R b)     { return prefix##_cmp_##suffix(a,b,_CMP_GT_OQ); } \
+  __attribute__((target("avx2")))                                         \
+  static R blend(R a, R b, R mask) { return prefix##_blendv_##suffix(a,b,mask); }
+
+SIMUL_SIMD(sse2,double,__m128d,2,pd,_mm);
+SIMUL_SIMD(sse2,float,__m128,4,ps,_mm);
+SIMUL_SIMD(avx2,double,__m256d,4,pd,_mm256);
+SIMUL_SIMD(avx2,float,__m256,8,ps,_mm256);
+
+#undef SIMUL_SIMD_COMPARE_avx2
+#undef SIMUL_SIMD_COMPARE_sse2
+#undef SIMUL_SIMD
+
+/* Each kernel is instantiated once per set of wrappers S; the target
+   attribute lets the wrappers be inlined into it. */
+
+#define SIMUL_KERNELS(target_name)                                        \
+                                                                          \
+template <class S>                                                        \
+__attribute__((target(#target_name)))                                     \
+void integrate_##target_name(typename S::T *x, const typename S::T *v,    \
+                             std::size_t n, typename S::T dt)             \
+{                                                                         \
+  const typename S::R vdt = S::set1(dt);                                  \
+  std::size_t i = 0;                                                      \
+  for ( ; i + S::lanes <= n ; i += S::lanes)                              \
+    S::store(x + i,S::add(S::load(x + i),S::mul(vdt,S::load(v + i))));    \
+  for ( ; i < n ; ++i)                                                    \
+    x[i] += dt * v[i];                                                    \
+}                                                                         \
+                                                                          \
+template <class S>                                                        \
+__attribute__((target(#target_name)))                                     \
+void walls_##target_name(typename S::T *x, typename S::T *v,              \
+                         const typename S::T *rad, std::size_t n,         \
+                         typename S::T eps)                               \
+{                                                                         \
+  using T = typename S::T;                                                \
+  using R = typename S::R;                                                \
+  const R zero = S::zero();                                               \
+  const R one  = S::set1(T(1));                                           \
+  const R veps = S::set1(eps);                                            \
+  const R sign = S::set1(T(-0.0));                                        \
+  std::size_t i = 0;                                                      \
+  for ( ; i + S::lanes <= n ; i += S::lanes)                              \
+    {                                                                     \
+      R px = S::load(x + i);                                              \
+      R pv = S::load(v + i);                                              \
+      R r  = S::load(rad + i);                                            \
+                                                                          \
+      R low = S::less(S::sub(px,r),zero);                                 \
+      px = S::blend(px,S::add(r,veps),low);                               \
+      pv = S::blend(pv,S::bit_xor(pv,sign),low);                          \
+                                                                          \
+      R high = S::greater(S::add(px,r),one);                              \
+      px = S::blend(px,S::sub(S::sub(one,r),veps),high);                  \
+      pv = S::blend(pv,S::bit_xor(pv,sign),high);                         \
+                                                                          \
+      S::store(x + i,px);                                                 \
+      S::store(v + i,pv);                                                 \
+    }                                                                     \
+  for ( ; i < n ; ++i)                                                    \
+    wall_scalar(x[i],v[i],rad[i],eps);                                    \
+}                                                                         \
+                                                                          \
+template <class S, std::size_t N>                                         \
+__attribute__((target(#target_name)))                                     \
+void gravity_##target_name(const typename S::T *const p[N],               \
+                           const typename S::T *m,                        \
+                           std::size_t n, std::size_t begin,              \
+                           std::size_t end, typename S::T G,              \
+                           typename S::T *const dv[N])                    \
+{                                                                         \
+  using T = typename S::T;                                                \
+  using R = typename S::R;                                                \
+  constexpr std::size_t L    = KernelSet<T,N>::gravity_lanes;             \
+  constexpr std::size_t regs = L / S::lanes;                              \
+  const R vG   = S::set1(G);                                              \
+  const R zero = S::zero();                                               \
+  for (std::size_t i = begin ; i < end ; ++i)                             \
+    {                                                                     \
+      R pi[N];                                                            \
+      R acc[N][regs];                                                     \
+      for (std::size_t k = 0 ; k < N ; ++k)                               \
+        {                                                                 \
+          pi[k] = S::set1(p[k][i]);                                       \
+          for (std::size_t h = 0 ; h < regs ; ++h)                        \
+            acc[k][h] = zero;                                             \
+        }                                                                 \
+      const R mi = S::set1(m[i]);                                         \
+                                                                          \
+      for (std::size_t j = 0 ; j + L <= n ; j += L)                       \
+        for (std::size_t h = 0 ; h < regs ; ++h)                          \
+          {                                                               \
+            const std::size_t jh = j + h * S::lanes;                      \
+            R d[N];                                                       \
+            for (std::size_t k = 0 ; k < N ; ++k)                         \
+              d[k] = S::sub(pi[k],S::load(p[k] + jh));                    \
+            R r2 = S::mul(d[0],d[0]);                                     \
+            for (std::size_t k = 1 ; k < N ; ++k)                         \
+              r2 = S::add(r2,S::mul(d[k],d[k]));                          \
+            R s = S::mul(vG,S::div(S::add(mi,S::load(m + jh)),r2));       \
+            s = S::bit_and(S::greater(r2,zero),s);                        \
+            for (std::size_t k = 0 ; k < N ; ++k)                         \
+              acc[k][h] = S::add(acc[k][h],S::mul(s,d[k]));               \
+          }                                                               \
+                                                                          \
+      T sums[N][L];                                                       \
+      T *a[N];                                                            \
+      for (std::size_t k = 0 ; k < N ; ++k)                               \
+        {                                                                 \
+          for (std::size_t h = 0 ; h < regs ; ++h)                        \
+            S::store(sums[k] + h * S::lanes,acc[k][h]);                   \
+          a[k] = sums[k];                                                 \
+        }                                                                 \
+      gravity_tail<T,N>(p,m,n,i,G,a,dv,i - begin);                        \
+    }                                                                     \
+}
+
+/* SSE2 kernels. */
+SIMUL_KERNELS(sse2)
+
+/* AVX2 kernels. */
+SIMUL_KERNELS(avx2)
+
+#undef SIMUL_KERNELS
+
+template <class T> struct Simd;
+
+template <> struct Simd<double>
+{
+  using sse2 = sse2_double;
+  using avx2 = avx2_double;
+};
+
+template <> struct Simd<float>
+{
+  using sse2 = sse2_float;
+  using avx2 = avx2_float;
+};
+
+#endif // SIMUL_X86
+
+} // namespace
+
+template <class T, std::size_t N>
+const KernelSet<T,N> &scalar_kernels()
+{
+  static const KernelSet<T,N> kernels {
+    "scalar", integrate_scalar<T>, walls_scalar<T>, gravity_scalar<T,N>
+  };
+  return kernels;
+}
+
+template <class T, std::size_t N>
+const KernelSet<T,N> &sse2_kernels()
+{
+#ifdef SIMUL_X86
+  using S = typename Simd<T>::sse2;
+  static const KernelSet<T,N> kernels {
+    "sse2", integrate_sse2<S>, walls_sse2<S>, gravity_sse2<S,N>
+  };
+  return kernels;
+#else
+  return scalar_kernels<T,N>();
+#endif
+}
+
+template <class T, std::size_t N>
+const KernelSet<T,N> &avx2_kernels()
+{
+#ifdef SIMUL_X86
+  using S = typename Simd<T>::avx2;
+  static const KernelSet<T,N> kernels {
+    "avx2", integrate_avx2<S>, walls_avx2<S>, gravity_avx2<S,N>
+  };
+  return kernels;
+#else
+  return scalar_kernels<T,N>();
+#endif
+}
+
+template <class T, std::size_t N>
+bool kernels_supported(const KernelSet<T,N> &kernels)
+{
+#ifdef SIMUL_X86
+  __builtin_cpu_init();
+  if (&kernels == &avx2_kernels<T,N>())
+    return __builtin_cpu_supports("avx2");
+  if (&kernels == &sse2_kernels<T,N>())
+    return __builtin_cpu_supports("sse2");
+#endif
+  return (&kernels == &scalar_kernels<T,N>());
+}
+
+template <class T, std::size_t N>
+const KernelSet<T,N> &best_kernels()
+{
+  static const KernelSet<T,N> &best =
+    (kernels_supported(avx2_kernels<T,N>()) ? avx2_kernels<T,N>()
+     : kernels_supported(sse2_kernels<T,N>()) ? sse2_kernels<T,N>()
+     : scalar_kernels<T,N>());
+  return best;
+}
+
+#define SIMUL_INSTANTIATE(T,N)                                          \
+  template const KernelSet<T,N> &scalar_kernels<T,N>();                 \
+  template const KernelSet<T,N> &sse2_kernels<T,N>();                   \
+  template const KernelSet<T,N> &avx2_kernels<T,N>();                   \
+  template bool kernels_supported<T,N>(const KernelSet<T,N> &);         \
+  template const KernelSet<T,N> &best_kernels<T,N>();
+
+SIMUL_INSTANTIATE(double,2)
+SIMUL_INSTANTIATE(double,3)
+SIMUL_INSTANTIATE(float,2)
+SIMUL_INSTANTIATE(float,3)
+
+#undef SIMUL_INSTANTIATE
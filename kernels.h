@@ -0,0 +1,79 @@
+#ifndef GTKMM_EXAMPLE_KERNELS_H
+#define GTKMM_EXAMPLE_KERNELS_H
+
+#include <cstddef>
+
+#include "./policy.h"
+
+/**
+   The inner loops of the physics step, working on the arrays of a
+   Particles object, for numbers of type T in N dimensions.
+
+   There is one set of these for each instruction set (plain C++,
+   SSE2, AVX2). All sets give bit-identical results: the vector
+   versions don't use fused multiply-add, and the gravity kernel of
+   every set sums up its terms in gravity_lanes lanes (as many as fit
+   into an AVX2 register), which are added up in the same order at the
+   end.
+
+   The sets are instantiated for float and double, in two and three
+   dimensions (see kernels.cpp); Kernels is the one chosen by the
+   policy in policy.h. Use best_kernels() to get the fastest set the
+   CPU supports. The choice is made once, at the first call.
+ */
+template <class T, std::size_t N>
+struct KernelSet
+{
+  using value_type = T;
+  static constexpr std::size_t dims          = N;
+  static constexpr std::size_t gravity_lanes = 32 / sizeof(T);
+
+  const char *name;
+
+  /**
+     x[i] += dt * v[i] for i in [0,n).
+   */
+  void (*integrate)(T *x, const T *v, std::size_t n, T dt);
+
+  /**
+     Reflect the balls off the walls at 0 and 1 along one axis: a ball
+     that sticks out of a wall is moved back inside (by eps) and the
+     component v[i] of its velocity is negated.
+   */
+  void (*walls)(T *x, T *v, const T *rad, std::size_t n, T eps);
+
+  /**
+     Velocity change of the balls i in [begin,end) caused by all n
+     balls, whose coordinate k is in the array p[k]:
+
+       dv[i] = sum over j with p_j != p_i of
+                 G * (m_i + m_j) / |p_i - p_j|² * (p_i - p_j)
+
+     Coordinate k of the result is written to dv[k][i - begin].
+   */
+  void (*gravity)(const T *const p[N], const T *m,
+                  std::size_t n, std::size_t begin, std::size_t end,
+                  T G, T *const dv[N]);
+};
+
+using Kernels = KernelSet<real,Physics::dims>;
+
+template <class T = real, std::size_t N = Physics::dims>
+const KernelSet<T,N> &scalar_kernels();
+
+template <class T = real, std::size_t N = Physics::dims>
+const KernelSet<T,N> &sse2_kernels();
+
+template <class T = real, std::size_t N = Physics::dims>
+const KernelSet<T,N> &avx2_kernels();
+
+/**
+   Whether the CPU we are running on supports the given set.
+ */
+template <class T, std::size_t N>
+bool kernels_supported(const KernelSet<T,N> &kernels);
+
+template <class T = real, std::size_t N = Physics::dims>
+const KernelSet<T,N> &best_kernels();
+
+#endif // GTKMM_EXAMPLE_KERNELS_H
@@ -1,16 +1,41 @@
 #include "./balls.h"
 #include <gtkmm/application.h>
 #include <gtkmm/window.h>
+#include <thread>
+#include <string>
+#include <iostream>
 
+/*
+  Usage: simul [trajectory]
+
+  Without arguments, runs the simulation. With the name of a file
+  recorded by simul-headless --record, plays it back instead.
+*/
 int main(int argc, char **argv)
 {
+  /* The file name is taken out, so that Gtk::Application doesn't try
+     to open it. */
+  std::string trajectory;
+  if (argc > 1)
+    {
+      trajectory = argv[1];
+      argc = 1;
+    }
+
   auto app = Gtk::Application::create(argc, argv, "me.jogojapan.simul");
 
   Gtk::Window win;
   win.set_title("simul");
   win.set_default_size(800,800);
 
-  Balls balls(23,100);
+  Balls balls(23,(trajectory.empty() ? 100 : 0));
+  balls.simulation().threads(std::thread::hardware_concurrency());
+  balls.renderer().threads(std::thread::hardware_concurrency());
+  if (!trajectory.empty() && !balls.replay(trajectory))
+    {
+      std::cerr << "Cannot read the trajectory " << trajectory << ".\n";
+      return 1;
+    }
   win.add(balls);
   balls.show();
 
@@ -0,0 +1,274 @@
+#ifndef GTKMM_EXAMPLE_NEIGHBOR_LIST_H
+#define GTKMM_EXAMPLE_NEIGHBOR_LIST_H
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cstddef>
+
+#include "./vec.h"
+#include "./grid.h"
+#include "./thread_pool.h"
+
+/**
+   Verlet neighbor list: a broad phase that is kept from one step to
+   the next.
+
+   build() lists, for each ball i, the balls j > i that are closer
+   than rad_i + rad_j + skin, using a uniform grid whose cells are the
+   skin wider than the largest diameter. The skin is given in units
+   of the largest radius. As long as no ball has moved further than
+   half the skin since, no pair that isn't on the list can touch, and
+   the list can be used as it is; stale() tells when that is no
+   longer so.
+
+   Each pair carries the number of substeps for which a collision
+   between its balls is still ignored, which the caller counts down.
+   These cooldowns are carried over to the next build() by the ids of
+   the balls, so they survive the balls being reordered.
+
+   Use as follows: call stale() at the start of each collision pass,
+   and build() if it returns true; then go through the pairs of each
+   ball i with begin(i) and end(i). invalidate() forces the next
+   build(), e.g. after the balls have been reordered or replaced.
+
+   The lists are only made for the first rows balls (e.g. the awake
+   ones), but they include all balls as the second of a pair.
+ */
+class NeighborList
+{
+public:
+  struct Pair
+  {
+    std::size_t j;
+    unsigned    cooldown;
+  };
+
+  NeighborList()
+    : grid_(),
+      skin_(0.0),
+      width_(0.0),
+      rows_(0),
+      valid_(false),
+      builds_(0),
+      start_(),
+      pairs_(),
+      x0_(),
+      y0_(),
+      ids_(),
+      hot_(),
+      slot_(),
+      warm_start_(),
+      warm_()
+  { }
+
+  void invalidate()
+  { valid_ = false; }
+
+  /**
+     Whether the list has to be built again for n balls, with the
+     lists of the first rows of them, at the positions given by pos.
+   */
+  template <class PosFunc>
+  bool stale(std::size_t n, std::size_t rows, double skin, PosFunc &&pos) const
+  {
+    if (!valid_ || n != x0_.size() || rows != rows_ || skin != skin_)
+      return true;
+    const double max_sqr = sqr(width_ / 2);
+    for (std::size_t i = 0 ; i < n ; ++i)
+      {
+        const Vec2d p = pos(i);
+        if (sqr(p.x - x0_[i]) + sqr(p.y - y0_[i]) > max_sqr)
+          return true;
+      }
+    return false;
+  }
+
+  template <class PosFunc, class RadFunc, class IdFunc>
+  void build(std::size_t n, std::size_t rows, double skin,
+             PosFunc &&pos, RadFunc &&rad, IdFunc &&id, ThreadPool &pool)
+  {
+    remember_cooldowns();
+
+    double max_rad = 0.0;
+    x0_.resize(n);
+    y0_.resize(n);
+    ids_.resize(n);
+    for (std::size_t i = 0 ; i < n ; ++i)
+      {
+        const Vec2d p = pos(i);
+        x0_[i]  = p.x;
+        y0_[i]  = p.y;
+        ids_[i] = id(i);
+        max_rad = std::max(max_rad,double(rad(i)));
+      }
+    place_cooldowns(rows);
+    const double width = skin * max_rad;
+    grid_.build(n,2 * max_rad + width,[this](std::size_t i) {
+        return Vec2d { x0_[i], y0_[i] };
+      });
+
+    auto near = [&](std::size_t i, std::size_t j) {
+      return j > i && (sqr(x0_[i] - x0_[j]) + sqr(y0_[i] - y0_[j])
+                       < sqr(double(rad(i)) + rad(j) + width));
+    };
+    /* The pairs are counted first, and then written to their place,
+       so that both passes can run in parallel. */
+    start_.assign(rows + 1,0);
+    pool.parallel_for(rows,1024,[&](std::size_t b, std::size_t e, unsigned) {
+        for (std::size_t i = b ; i < e ; ++i)
+          grid_.foreach_neighbor(i,[&](std::size_t j) {
+              if (near(i,j))
+                ++start_[i + 1];
+            });
+      });
+    for (std::size_t i = 0 ; i < rows ; ++i)
+      start_[i + 1] += start_[i];
+
+    grow(pairs_,start_[rows]);
+    pool.parallel_for(rows,1024,[&](std::size_t b, std::size_t e, unsigned) {
+        for (std::size_t i = b ; i < e ; ++i)
+          {
+            Pair *const first = pairs_.data() + start_[i];
+            Pair *out = first;
+            grid_.foreach_neighbor(i,[&](std::size_t j) {
+                if (near(i,j))
+                  *out++ = { j, cooldown(i,j) };
+              });
+            std::sort(first,out,[](const Pair &a, const Pair &b) { return a.j < b.j; });
+          }
+      });
+
+    skin_  = skin;
+    width_ = width;
+    rows_  = rows;
+    valid_ = true;
+    ++builds_;
+  }
+
+  Pair *begin(std::size_t i)
+  { return pairs_.data() + start_[i]; }
+
+  Pair *end(std::size_t i)
+  { return pairs_.data() + start_[i + 1]; }
+
+  /**
+     The grid of the most recent build(). Balls only have pairs with
+     balls in the same or an adjacent cell of it, whatever they have
+     done since.
+   */
+  const UniformGrid &grid() const
+  { return grid_; }
+
+  std::size_t rows() const
+  { return rows_; }
+
+  /**
+     Number of pairs on the list.
+   */
+  std::size_t size() const
+  { return pairs_.size(); }
+
+  /**
+     Number of times the list has been built.
+   */
+  unsigned long builds() const
+  { return builds_; }
+
+private:
+  /* A pair with a cooldown, by the ids of its balls. */
+  struct Hot
+  {
+    std::size_t a;
+    std::size_t b;
+    unsigned    cooldown;
+  };
+
+  /* Keep the pairs of the current list that are cooling down. */
+  void remember_cooldowns()
+  {
+    hot_.clear();
+    for (std::size_t i = 0 ; i < rows_ && i + 1 < start_.size() ; ++i)
+      for (std::size_t k = start_[i] ; k < start_[i + 1] ; ++k)
+        if (pairs_[k].cooldown > 0)
+          hot_.push_back({ ids_[i], ids_[pairs_[k].j], pairs_[k].cooldown });
+  }
+
+  /* Sort the remembered pairs into the rows of the new indices of
+     their balls (by counting, as in the grid), dropping those of
+     balls that are gone. Ids are small numbers, so they can index
+     slot_, which covers the ids of all balls, so that its size stays
+     the same from one build to the next. */
+  void place_cooldowns(std::size_t rows)
+  {
+    static const std::size_t gone = ~std::size_t(0);
+    std::size_t max_id = 0;
+    for (const Hot &hot : hot_)
+      max_id = std::max(max_id,std::max(hot.a,hot.b));
+    for (std::size_t id : ids_)
+      max_id = std::max(max_id,id);
+    slot_.assign(max_id + 1,gone);
+    for (std::size_t i = 0 ; i < ids_.size() ; ++i)
+      if (ids_[i] < slot_.size())
+        slot_[ids_[i]] = i;
+
+    for (Hot &hot : hot_)
+      {
+        const std::size_t i = slot_[hot.a];
+        const std::size_t j = slot_[hot.b];
+        hot.a = std::min(i,j);
+        hot.b = std::max(i,j);
+      }
+    warm_start_.assign(rows + 1,0);
+    for (const Hot &hot : hot_)
+      if (hot.b != gone && hot.a < rows)
+        ++warm_start_[hot.a + 1];
+    for (std::size_t i = 0 ; i < rows ; ++i)
+      warm_start_[i + 1] += warm_start_[i];
+    grow(warm_,warm_start_[rows]);
+    for (const Hot &hot : hot_)
+      if (hot.b != gone && hot.a < rows)
+        warm_[warm_start_[hot.a]++] = { hot.b, hot.cooldown };
+    for (std::size_t i = rows ; i > 0 ; --i)
+      warm_start_[i] = warm_start_[i - 1];
+    warm_start_[0] = 0;
+  }
+
+  /* Resize v to n, with room for half as much again when it has to
+     grow, so that a list that grows by a few pairs from one build to
+     the next doesn't allocate in every build. */
+  template <class T>
+  static void grow(std::vector<T> &v, std::size_t n)
+  {
+    if (n > v.capacity())
+      v.reserve(n + n / 2);
+    v.resize(n);
+  }
+
+  /* The cooldown remembered for the pair of balls i < j. */
+  unsigned cooldown(std::size_t i, std::size_t j) const
+  {
+    for (std::size_t k = warm_start_[i] ; k < warm_start_[i + 1] ; ++k)
+      if (warm_[k].j == j)
+        return warm_[k].cooldown;
+    return 0;
+  }
+
+  UniformGrid              grid_;
+  double                   skin_;
+  double                   width_;
+  std::size_t              rows_;
+  bool                     valid_;
+  unsigned long            builds_;
+  std::vector<std::size_t> start_;
+  std::vector<Pair>        pairs_;
+  std::vector<double>      x0_;
+  std::vector<double>      y0_;
+  std::vector<std::size_t> ids_;
+  std::vector<Hot>         hot_;
+  std::vector<std::size_t> slot_;
+  std::vector<std::size_t> warm_start_;
+  std::vector<Pair>        warm_;
+};
+
+#endif // GTKMM_EXAMPLE_NEIGHBOR_LIST_H
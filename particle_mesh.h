@@ -0,0 +1,316 @@
+#ifndef GTKMM_EXAMPLE_PARTICLE_MESH_H
+#define GTKMM_EXAMPLE_PARTICLE_MESH_H
+
+#include <vector>
+#include <complex>
+#include <algorithm>
+#include <utility>
+#include <cstddef>
+#include <cmath>
+
+#include "./vec.h"
+#include "./thread_pool.h"
+
+/**
+   Particle-mesh approximation of the gravity pass.
+
+   The exact kernel changes the velocity of ball i by
+
+     G * (m_i + m_j) / |p_i - p_j|² * (p_i - p_j)
+
+   for every other ball j, i.e. by G * (E_m(p_i) + m_i * E_1(p_i)),
+   where E_w(p) is the sum of w_j (p - p_j) / |p - p_j|² over the
+   balls, with w_j = m_j for E_m and w_j = 1 for E_1.
+
+   The mesh has size() x size() cells over the unit square. build()
+   deposits the masses and the counts of the balls onto the centers
+   of the cells with cloud-in-cell weights, as the real and imaginary
+   parts of one complex density, and convolves it with the kernel
+   d / |d|² by FFT, on a mesh padded to twice the size so that the
+   convolution isn't periodic. field() interpolates the result at the
+   ball with the same weights, so that a ball exerts no force on
+   itself. Balls outside of the unit square are taken to be on its
+   edge.
+
+   The cost is linear in the number of balls, plus a few FFTs of
+   (2 size())² points. Forces are smoothed out at the scale of a cell,
+   so close pairs are too weak.
+
+   With split(r), the mesh only carries the long-range part of the
+   kernel, d / |d|² * (1 - short_range(|d|²)), which is smooth at the
+   scale of r, so that it is represented well by a mesh with cells a
+   few times smaller than r. The rest, d / |d|² * short_range(|d|²),
+   is zero beyond r, and the caller adds it up exactly over the pairs
+   closer than that (particle-particle particle-mesh, or P3M).
+
+   Use as follows: call build() with the number of balls, functions
+   returning the position and mass of ball i, and a thread pool for
+   the FFTs; then call field() for each ball.
+ */
+class ParticleMesh
+{
+public:
+  using complex = std::complex<double>;
+
+  enum : std::size_t { default_size = 128 };
+
+  explicit ParticleMesh(std::size_t size = default_size)
+    : size_(0),
+      split_(0.0),
+      kx_(),
+      ky_(),
+      rho_(),
+      ex_(),
+      ey_(),
+      pos_(),
+      mass_()
+  {
+    this->size(size);
+  }
+
+  std::size_t size() const
+  { return size_; }
+
+  /**
+     Set the number of cells along a side, rounded up to a power of
+     two (for the FFT).
+   */
+  void size(std::size_t cells)
+  {
+    std::size_t n = 2;
+    while (n < cells)
+      n *= 2;
+    if (n != size_)
+      {
+        size_ = n;
+        kx_.clear();
+        ky_.clear();
+      }
+  }
+
+  /**
+     Leave the pull of balls closer than radius to the caller (see
+     short_range()); 0 for the whole pull on the mesh.
+   */
+  void split(double radius)
+  {
+    if (radius != split_)
+      {
+        split_ = radius;
+        kx_.clear();
+        ky_.clear();
+      }
+  }
+
+  double split() const
+  { return split_; }
+
+  /**
+     The share of the pull between two balls at squared distance r2
+     that the mesh leaves out: 1 at 0, falling smoothly to 0 at the
+     split radius and beyond (as 1 - 3u² + 2u³ of u = |d| / r).
+   */
+  double short_range(double r2) const
+  {
+    if (!(r2 < split_ * split_))
+      return 0.0;
+    const double u = ::sqrt(r2) / split_;
+    return 1.0 - u * u * (3.0 - 2.0 * u);
+  }
+
+  template <class PosFunc, class MassFunc>
+  void build(std::size_t n, PosFunc &&pos, MassFunc &&mass, ThreadPool &pool)
+  {
+    const std::size_t side = 2 * size_;
+    if (kx_.empty())
+      kernel(pool);
+
+    pos_.resize(n);
+    mass_.resize(n);
+    rho_.assign(side * side,complex());
+    for (std::size_t i = 0 ; i < n ; ++i)
+      {
+        pos_[i]  = pos(i);
+        mass_[i] = mass(i);
+        Weights w(*this,pos_[i]);
+        const complex value(mass_[i],1.0);
+        for (std::size_t k = 0 ; k < 4 ; ++k)
+          rho_[w.node[k]] += w.weight[k] * value;
+      }
+
+    fft2(rho_,false,pool);
+    ex_.resize(side * side);
+    ey_.resize(side * side);
+    pool.parallel_for(side * side,4096,[this](std::size_t b, std::size_t e, unsigned) {
+        for (std::size_t k = b ; k < e ; ++k)
+          {
+            ex_[k] = rho_[k] * kx_[k];
+            ey_[k] = rho_[k] * ky_[k];
+          }
+      });
+    fft2(ex_,true,pool);
+    fft2(ey_,true,pool);
+  }
+
+  /**
+     The change of velocity of ball i caused by all other balls,
+     with gravitational constant G.
+   */
+  Vec2d field(std::size_t i, double G) const
+  {
+    const Weights w(*this,pos_[i]);
+    complex ex, ey;
+    for (std::size_t k = 0 ; k < 4 ; ++k)
+      {
+        ex += w.weight[k] * ex_[w.node[k]];
+        ey += w.weight[k] * ey_[w.node[k]];
+      }
+    return { G * (ex.real() + mass_[i] * ex.imag()),
+             G * (ey.real() + mass_[i] * ey.imag()) };
+  }
+
+private:
+  /* The four cells around a position, and their cloud-in-cell
+     weights, as indices into the padded mesh. */
+  struct Weights
+  {
+    std::size_t node[4];
+    double      weight[4];
+
+    Weights(const ParticleMesh &mesh, Vec2d p)
+    {
+      std::size_t x0, y0;
+      double      fx, fy;
+      mesh.locate(p.x,x0,fx);
+      mesh.locate(p.y,y0,fy);
+      const std::size_t side = 2 * mesh.size_;
+      const std::size_t x1   = x0 + 1;
+      const std::size_t y1   = y0 + 1;
+      node[0] = y0 * side + x0;  weight[0] = (1 - fx) * (1 - fy);
+      node[1] = y0 * side + x1;  weight[1] = fx * (1 - fy);
+      node[2] = y1 * side + x0;  weight[2] = (1 - fx) * fy;
+      node[3] = y1 * side + x1;  weight[3] = fx * fy;
+    }
+  };
+
+  /* The cell center at or below v, and the fraction of the way to
+     the next one. */
+  void locate(double v, std::size_t &cell, double &frac) const
+  {
+    const double u = std::min(std::max(v * size_ - 0.5,0.0),double(size_ - 1));
+    cell = std::min(static_cast<std::size_t>(u),size_ - 2);
+    frac = u - cell;
+  }
+
+  /* The transform of the kernel d / |d|², less its short-range part,
+     with the 1/(2 size)² of the inverse transform folded in. */
+  void kernel(ThreadPool &pool)
+  {
+    const std::size_t side = 2 * size_;
+    const double      h    = 1.0 / size_;
+    const double      norm = 1.0 / (side * side);
+    kx_.assign(side * side,complex());
+    ky_.assign(side * side,complex());
+    for (std::size_t y = 0 ; y < side ; ++y)
+      for (std::size_t x = 0 ; x < side ; ++x)
+        {
+          /* Offsets beyond size_ stand for negative ones. */
+          const double dx = h * (x < size_ ? double(x) : double(x) - side);
+          const double dy = h * (y < size_ ? double(y) : double(y) - side);
+          const double r2 = dx * dx + dy * dy;
+          if (r2 > 0)
+            {
+              const double s = norm * (1.0 - short_range(r2));
+              kx_[y * side + x] = s * dx / r2;
+              ky_[y * side + x] = s * dy / r2;
+            }
+        }
+    fft2(kx_,false,pool,side);
+    fft2(ky_,false,pool,side);
+  }
+
+  /**
+     2D FFT of the padded mesh, rows first and then columns, or
+     columns first for the inverse. Only the first rows rows are
+     transformed by rows (the others are zero before the forward
+     transform, and not needed after the inverse one).
+   */
+  void fft2(std::vector<complex> &a, bool inverse, ThreadPool &pool) const
+  { fft2(a,inverse,pool,size_); }
+
+  void fft2(std::vector<complex> &a, bool inverse, ThreadPool &pool, std::size_t rows) const
+  {
+    const std::size_t side = 2 * size_;
+    auto by_rows = [&]() {
+      pool.parallel_for(rows,4,[&](std::size_t b, std::size_t e, unsigned) {
+          for (std::size_t y = b ; y < e ; ++y)
+            fft(&a[y * side],side,1,inverse);
+        });
+    };
+    auto by_columns = [&]() {
+      pool.parallel_for(side,4,[&](std::size_t b, std::size_t e, unsigned) {
+          for (std::size_t x = b ; x < e ; ++x)
+            fft(&a[x],side,side,inverse);
+        });
+    };
+    if (inverse)
+      {
+        by_columns();
+        by_rows();
+      }
+    else
+      {
+        by_rows();
+        by_columns();
+      }
+  }
+
+  /**
+     In-place radix-2 FFT of the n values a[0], a[stride], ...,
+     with n a power of two. The inverse isn't scaled.
+   */
+  static void fft(complex *a, std::size_t n, std::size_t stride, bool inverse)
+  {
+    for (std::size_t i = 1, j = 0 ; i < n ; ++i)
+      {
+        std::size_t bit = n >> 1;
+        for ( ; j & bit ; bit >>= 1)
+          j ^= bit;
+        j ^= bit;
+        if (i < j)
+          std::swap(a[i * stride],a[j * stride]);
+      }
+
+    for (std::size_t len = 2 ; len <= n ; len <<= 1)
+      {
+        const double  angle = (inverse ? 2 : -2) * M_PI / len;
+        const complex step(::cos(angle),::sin(angle));
+        for (std::size_t i = 0 ; i < n ; i += len)
+          {
+            complex w(1.0,0.0);
+            for (std::size_t j = 0 ; j < len / 2 ; ++j)
+              {
+                complex &lo = a[(i + j) * stride];
+                complex &hi = a[(i + j + len / 2) * stride];
+                const complex u = lo;
+                const complex v = hi * w;
+                lo = u + v;
+                hi = u - v;
+                w *= step;
+              }
+          }
+      }
+  }
+
+  std::size_t          size_;
+  double               split_;
+  std::vector<complex> kx_;
+  std::vector<complex> ky_;
+  std::vector<complex> rho_;
+  std::vector<complex> ex_;
+  std::vector<complex> ey_;
+  std::vector<Vec2d>   pos_;
+  std::vector<double>  mass_;
+};
+
+#endif // GTKMM_EXAMPLE_PARTICLE_MESH_H
@@ -0,0 +1,230 @@
+#ifndef GTKMM_EXAMPLE_PARTICLES_H
+#define GTKMM_EXAMPLE_PARTICLES_H
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+#include "./vec.h"
+#include "./policy.h"
+
+/**
+   A single ball, as a value. This is what random_ball() creates and
+   what is handed to Particles::push_back(); the simulation itself
+   works on the arrays of Particles.
+ */
+struct Ball
+{
+  Vec2d p;
+  Vec2d v;
+  double m;
+  double rad;
+  double color_r;
+  double color_g;
+  double color_b;
+
+  Ball(Vec2d pos,
+       Vec2d vel,
+       double mass = 0.1,
+       double r    = 0.2,
+       double g    = 0.2,
+       double b    = 0.2)
+    : p(pos),
+      v(vel),
+      m(mass),
+      rad(0.12 * mass),
+      color_r(r),
+      color_g(g),
+      color_b(b)
+  { }
+
+  Ball()
+    : Ball({0.0d,0.0d},{0.0d,0.0d})
+  { }
+};
+
+/**
+   Structure-of-arrays store for the balls.
+
+   The fields used in every pass of the physics step (position,
+   velocity, mass, radius) are held in separate arrays of the number
+   type chosen in policy.h, so that a loop over one of them doesn't
+   pull the others into the cache. The fields that are rarely touched
+   (colors, collision bookkeeping) are kept in a side table.
+
+   Ball number i is made up of entry i of every array. Use view(i) to
+   read a ball as a whole, e.g. for drawing.
+
+   The index of a ball changes when the balls are reordered (see
+   permute()). Each ball also has an id, which doesn't: push_back()
+   gives the balls the ids 0, 1, 2, ... in turn, so the ids are
+   a permutation of the indices, unless balls are added together
+   with their cold entry, as a domain of a distributed run does with
+   the balls it gets from the others (see domain.h). Anything that
+   refers to a ball across steps, such as the bookkeeping of recent
+   collisions, uses the id.
+ */
+class Particles
+{
+public:
+  enum : std::size_t { none = static_cast<std::size_t>(-1) };
+
+  struct Cold
+  {
+    double color_r;
+    double color_g;
+    double color_b;
+
+    std::size_t id;
+
+    /* The id of the ball most recently collided with, and for how
+       many more steps a collision with it is ignored. */
+    std::pair<std::size_t,unsigned> recent_collision;
+
+    /* Number of steps in a row the ball has been slower than the
+       sleep speed (see Simulation::sleep()). */
+    unsigned calm;
+  };
+
+  class View
+  {
+  public:
+    View(const Particles &particles, std::size_t i)
+      : particles_(particles), i_(i)
+    { }
+
+    Vec2d p() const
+    { return { particles_.x[i_], particles_.y[i_] }; }
+
+    Vec2d v() const
+    { return { particles_.vx[i_], particles_.vy[i_] }; }
+
+    double m() const
+    { return particles_.m[i_]; }
+
+    double rad() const
+    { return particles_.rad[i_]; }
+
+    double color_r() const
+    { return particles_.cold[i_].color_r; }
+
+    double color_g() const
+    { return particles_.cold[i_].color_g; }
+
+    double color_b() const
+    { return particles_.cold[i_].color_b; }
+
+  private:
+    const Particles &particles_;
+    std::size_t      i_;
+  };
+
+  std::vector<real> x;
+  std::vector<real> y;
+  std::vector<real> vx;
+  std::vector<real> vy;
+  std::vector<real> m;
+  std::vector<real> rad;
+  std::vector<Cold> cold;
+
+  std::size_t size() const
+  { return x.size(); }
+
+  void reserve(std::size_t n)
+  {
+    x.reserve(n);
+    y.reserve(n);
+    vx.reserve(n);
+    vy.reserve(n);
+    m.reserve(n);
+    rad.reserve(n);
+    cold.reserve(n);
+  }
+
+  void push_back(const Ball &ball)
+  {
+    const std::size_t id = size();
+    x.push_back(ball.p.x);
+    y.push_back(ball.p.y);
+    vx.push_back(ball.v.x);
+    vy.push_back(ball.v.y);
+    m.push_back(ball.m);
+    rad.push_back(ball.rad);
+    cold.push_back({ ball.color_r, ball.color_g, ball.color_b, id, { none, 0 }, 0 });
+  }
+
+  /**
+     Append a ball with the given cold entry, e.g. one taken from
+     another Particles. Unlike push_back(ball), this keeps the id of
+     the entry.
+   */
+  void push_back(const Ball &ball, const Cold &entry)
+  {
+    x.push_back(ball.p.x);
+    y.push_back(ball.p.y);
+    vx.push_back(ball.v.x);
+    vy.push_back(ball.v.y);
+    m.push_back(ball.m);
+    rad.push_back(ball.rad);
+    cold.push_back(entry);
+  }
+
+  View view(std::size_t i) const
+  { return View(*this,i); }
+
+  /**
+     The index of the ball with the given id, or none. This is a
+     linear search.
+   */
+  std::size_t index_of(std::size_t id) const
+  {
+    for (std::size_t i = 0 ; i < cold.size() ; ++i)
+      if (cold[i].id == id)
+        return i;
+    return none;
+  }
+
+  /**
+     Reorder the balls so that ball k becomes what was ball order[k],
+     for a permutation order of [0,size()). The permutation is done in
+     place, cycle by cycle, and order is overwritten in the process.
+   */
+  void permute(std::size_t *order)
+  {
+    const std::size_t n = size();
+    for (std::size_t k = 0 ; k < n ; ++k)
+      {
+        if (order[k] == k)
+          continue;
+
+        const real x0 = x[k], y0 = y[k], vx0 = vx[k], vy0 = vy[k];
+        const real m0 = m[k], rad0 = rad[k];
+        const Cold cold0 = cold[k];
+
+        std::size_t j = k;
+        while (order[j] != k)
+          {
+            const std::size_t from = order[j];
+            x[j]     = x[from];
+            y[j]     = y[from];
+            vx[j]    = vx[from];
+            vy[j]    = vy[from];
+            m[j]     = m[from];
+            rad[j]   = rad[from];
+            cold[j]  = cold[from];
+            order[j] = j;
+            j = from;
+          }
+        x[j]     = x0;
+        y[j]     = y0;
+        vx[j]    = vx0;
+        vy[j]    = vy0;
+        m[j]     = m0;
+        rad[j]   = rad0;
+        cold[j]  = cold0;
+        order[j] = j;
+      }
+  }
+};
+
+#endif // GTKMM_EXAMPLE_PARTICLES_H
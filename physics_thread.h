@@ -0,0 +1,160 @@
+#ifndef GTKMM_EXAMPLE_PHYSICS_THREAD_H
+#define GTKMM_EXAMPLE_PHYSICS_THREAD_H
+
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include "./simulation.h"
+#include "./triple_buffer.h"
+
+/**
+   The state of the simulation as handed to the renderer.
+ */
+struct Snapshot
+{
+  Particles         balls;
+  unsigned long     steps         = 0;
+  double            gravity_error = 0.0;
+  Profiler::Summary profile;
+};
+
+/**
+   Runs a Simulation on its own thread, at a fixed rate that does not
+   depend on how fast the window is redrawn.
+
+   The thread keeps an accumulator of elapsed wall-clock time and
+   takes one step of Simulation::time_lapse of simulated time for
+   each 1/rate seconds in it. Each such step can be divided into
+   several substeps of the simulation. If the simulation can't keep
+   up, the accumulator is capped at max_lag steps, so that the thread
+   falls behind real time instead of trying to catch up forever.
+
+   After each round of steps, the state is copied into a triple
+   buffer. The renderer takes the newest snapshot with latest(),
+   which never blocks.
+
+   The Simulation must not be touched by anyone else between start()
+   and stop().
+ */
+class PhysicsThread
+{
+public:
+  static constexpr unsigned max_lag = 5;
+
+  explicit PhysicsThread(Simulation &sim)
+    : sim_(sim),
+      rate_(1000.0 / Simulation::time_lapse),
+      substeps_(1),
+      stop_(false),
+      thread_(),
+      buffer_()
+  {
+    publish();
+  }
+
+  PhysicsThread(const PhysicsThread &) = delete;
+  PhysicsThread &operator=(const PhysicsThread &) = delete;
+
+  ~PhysicsThread()
+  { stop(); }
+
+  /**
+     Number of steps of time_lapse per second of wall-clock time. The
+     default runs the simulation in real time.
+   */
+  void rate(double steps_per_second)
+  { rate_ = steps_per_second; }
+
+  double rate() const
+  { return rate_; }
+
+  /**
+     Number of substeps each step is divided into.
+   */
+  void substeps(unsigned n)
+  { substeps_ = std::max(1u,n); }
+
+  unsigned substeps() const
+  { return substeps_; }
+
+  bool running() const
+  { return thread_.joinable(); }
+
+  void start()
+  {
+    if (running())
+      return;
+    stop_ = false;
+    thread_ = std::thread(&PhysicsThread::run,this);
+  }
+
+  void stop()
+  {
+    if (!running())
+      return;
+    stop_ = true;
+    thread_.join();
+  }
+
+  /**
+     The newest state of the simulation. It stays valid until the next
+     call of latest(), which must come from the same (rendering)
+     thread.
+   */
+  const Snapshot &latest()
+  { return buffer_.acquire(); }
+
+private:
+  void run()
+  {
+    using clock   = std::chrono::steady_clock;
+    using seconds = std::chrono::duration<double>;
+
+    double accumulator = 0.0;
+    auto   last        = clock::now();
+    while (!stop_)
+      {
+        const double   period   = 1.0 / rate_;
+        const unsigned substeps = substeps_;
+
+        const auto now = clock::now();
+        accumulator = std::min(accumulator + seconds(now - last).count(),
+                               max_lag * period);
+        last = now;
+
+        if (accumulator >= period)
+          {
+            while (accumulator >= period)
+              {
+                for (unsigned s = 0 ; s < substeps ; ++s)
+                  sim_.step(double(Simulation::time_lapse) / substeps);
+                accumulator -= period;
+              }
+            publish();
+          }
+
+        std::this_thread::sleep_for(seconds(period - accumulator));
+      }
+  }
+
+  void publish()
+  {
+    Snapshot &snapshot = buffer_.back();
+    snapshot.balls         = sim_.balls();
+    snapshot.steps         = sim_.steps();
+    snapshot.gravity_error = sim_.last_gravity_error();
+    SIMUL_PROFILE_ONLY(snapshot.profile = sim_.profiler().summary();)
+    buffer_.publish();
+  }
+
+  Simulation             &sim_;
+  std::atomic<double>     rate_;
+  std::atomic<unsigned>   substeps_;
+  std::atomic<bool>       stop_;
+  std::thread             thread_;
+  TripleBuffer<Snapshot>  buffer_;
+};
+
+#endif // GTKMM_EXAMPLE_PHYSICS_THREAD_H
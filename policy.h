@@ -0,0 +1,39 @@
+#ifndef GTKMM_EXAMPLE_POLICY_H
+#define GTKMM_EXAMPLE_POLICY_H
+
+#include <cstddef>
+
+#include "./vec.h"
+
+/**
+   Compile-time choice of the number type the balls are stored in
+   (see Particles) and the kernels work on (see kernels.h), and of the
+   number of dimensions of the kernels.
+
+   Float takes half the memory and bandwidth of double, and fits
+   twice as many numbers into a SIMD register. The choice is made
+   once, here, so that there is no dispatch on it inside any loop.
+   The default is double; compile with -DSIMUL_SINGLE_PRECISION for
+   float. Intermediate results (collisions, the quadtree, the event
+   times) are computed in double either way.
+
+   The kernels are also instantiated for three dimensions, but the
+   simulation itself is two-dimensional.
+ */
+template <class Real, std::size_t Dims>
+struct PhysicsPolicy
+{
+  using real = Real;
+  static constexpr std::size_t dims = Dims;
+  using vec = Vec<Real,Dims>;
+};
+
+#ifdef SIMUL_SINGLE_PRECISION
+using Physics = PhysicsPolicy<float,2>;
+#else
+using Physics = PhysicsPolicy<double,2>;
+#endif
+
+using real = Physics::real;
+
+#endif // GTKMM_EXAMPLE_POLICY_H
@@ -0,0 +1,226 @@
+#ifndef GTKMM_EXAMPLE_PROFILER_H
+#define GTKMM_EXAMPLE_PROFILER_H
+
+#include <array>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <cstddef>
+
+/**
+   Timers for the phases of the physics step and for drawing, and
+   counters for the work done in a step.
+
+   The instrumentation is only compiled in when SIMUL_PROFILE is
+   defined (e.g. -DSIMUL_PROFILE). The code to be measured uses the
+   macros below, which expand to nothing otherwise:
+
+     SIMUL_PROFILE_SCOPE(profiler,phase)  times the rest of the scope
+     SIMUL_PROFILE_ONLY(statements)       for counting and reporting
+
+   Each Profiler keeps the most recent samples of each phase and
+   counter in a rolling window, for their mean and 99th percentile.
+   Counters add up over a step (or a frame) and are pushed into their
+   window by end_step(), which also writes a line to the CSV trace, if
+   one was opened with trace().
+
+   A Profiler must only be used by one thread. The simulation has one
+   on the physics thread, the window another one for drawing.
+ */
+class Profiler
+{
+public:
+  enum Phase : std::size_t { integrate, walls, collisions, gravity, draw, phases };
+  enum Counter : std::size_t { pairs, contacts, awake, counters };
+
+  /**
+     Number of samples the statistics are taken over.
+   */
+  enum : std::size_t { window = 128 };
+
+  struct Stats
+  {
+    double mean = 0.0;
+    double p99  = 0.0;
+  };
+
+  /**
+     Statistics of all phases (in microseconds) and of all counters
+     (per step), as handed to the renderer.
+   */
+  struct Summary
+  {
+    std::array<Stats,phases>   phase;
+    std::array<Stats,counters> counter;
+  };
+
+  static const char *name(Phase p)
+  {
+    static const char *names[] = { "integrate", "walls", "collisions", "gravity", "draw" };
+    return names[p];
+  }
+
+  static const char *name(Counter c)
+  {
+    static const char *names[] = { "pairs", "contacts", "awake" };
+    return names[c];
+  }
+
+  Profiler()
+    : phases_(),
+      counters_(),
+      current_(),
+      last_(),
+      trace_()
+  { }
+
+  void record(Phase p, double micros)
+  {
+    phases_[p].push(micros);
+    last_[p] = micros;
+  }
+
+  void count(Counter c, std::size_t n)
+  { current_[c] += n; }
+
+  /**
+     Close the counters of a step (or frame), and trace it.
+   */
+  void end_step()
+  {
+    for (std::size_t c = 0 ; c < counters ; ++c)
+      counters_[c].push(current_[c]);
+
+    if (trace_.is_open())
+      {
+        for (std::size_t p = 0 ; p < phases ; ++p)
+          trace_ << last_[p] << ',';
+        for (std::size_t c = 0 ; c < counters ; ++c)
+          trace_ << current_[c] << (c + 1 < counters ? ',' : '\n');
+      }
+
+    current_.fill(0);
+    last_.fill(0.0);
+  }
+
+  /**
+     Write the samples of each step to a CSV file, one line per step:
+     the time of each phase in microseconds (0 if it didn't run),
+     then the counters.
+   */
+  bool trace(const std::string &path)
+  {
+    trace_.open(path);
+    if (!trace_)
+      return false;
+    for (std::size_t p = 0 ; p < phases ; ++p)
+      trace_ << name(Phase(p)) << "_us,";
+    for (std::size_t c = 0 ; c < counters ; ++c)
+      trace_ << name(Counter(c)) << (c + 1 < counters ? ',' : '\n');
+    return true;
+  }
+
+  Stats stats(Phase p) const
+  { return phases_[p].stats(); }
+
+  Stats stats(Counter c) const
+  { return counters_[c].stats(); }
+
+  Summary summary() const
+  {
+    Summary s;
+    for (std::size_t p = 0 ; p < phases ; ++p)
+      s.phase[p] = stats(Phase(p));
+    for (std::size_t c = 0 ; c < counters ; ++c)
+      s.counter[c] = stats(Counter(c));
+    return s;
+  }
+
+private:
+  class Rolling
+  {
+  public:
+    Rolling()
+      : samples_(), size_(0), next_(0)
+    { }
+
+    void push(double v)
+    {
+      samples_[next_] = v;
+      next_ = (next_ + 1) % window;
+      size_ = std::min<std::size_t>(size_ + 1,window);
+    }
+
+    Stats stats() const
+    {
+      Stats s;
+      if (size_ == 0)
+        return s;
+
+      std::array<double,window> sorted;
+      std::copy(samples_.begin(),samples_.begin() + size_,sorted.begin());
+      double sum = 0.0;
+      for (std::size_t i = 0 ; i < size_ ; ++i)
+        sum += sorted[i];
+      s.mean = sum / size_;
+
+      const std::size_t k = (99 * size_ + 99) / 100 - 1;
+      std::nth_element(sorted.begin(),sorted.begin() + k,sorted.begin() + size_);
+      s.p99 = sorted[k];
+      return s;
+    }
+
+  private:
+    std::array<double,window> samples_;
+    std::size_t               size_;
+    std::size_t               next_;
+  };
+
+  std::array<Rolling,phases>           phases_;
+  std::array<Rolling,counters>         counters_;
+  std::array<std::size_t,counters>     current_;
+  std::array<double,phases>            last_;
+  std::ofstream                        trace_;
+};
+
+/**
+   Records the time from its construction to its destruction as a
+   sample of a phase.
+ */
+class ScopedTimer
+{
+public:
+  ScopedTimer(Profiler &profiler, Profiler::Phase phase)
+    : profiler_(profiler),
+      phase_(phase),
+      start_(clock::now())
+  { }
+
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+  ~ScopedTimer()
+  {
+    using micros = std::chrono::duration<double,std::micro>;
+    profiler_.record(phase_,micros(clock::now() - start_).count());
+  }
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  Profiler          &profiler_;
+  Profiler::Phase    phase_;
+  clock::time_point  start_;
+};
+
+#ifdef SIMUL_PROFILE
+#define SIMUL_PROFILE_SCOPE(profiler,phase) \
+  ScopedTimer simul_profile_timer_((profiler),(phase))
+#define SIMUL_PROFILE_ONLY(...) __VA_ARGS__
+#else
+#define SIMUL_PROFILE_SCOPE(profiler,phase)
+#define SIMUL_PROFILE_ONLY(...)
+#endif
+
+#endif // GTKMM_EXAMPLE_PROFILER_H
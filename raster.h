@@ -0,0 +1,189 @@
+#ifndef GTKMM_EXAMPLE_RASTER_H
+#define GTKMM_EXAMPLE_RASTER_H
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#include "./particles.h"
+#include "./grid.h"
+#include "./thread_pool.h"
+
+/**
+   Software rasterizer that draws the balls into an image buffer on
+   several threads, for ball counts at which even the batched Cairo
+   path is too slow on one thread.
+
+   The image is cut into tiles of tile_size x tile_size pixels, which
+   are drawn in parallel on a ThreadPool. To find the balls that
+   overlap a tile, the balls are binned into a UniformGrid, as in the
+   broad phase of the collisions, with cells at least as wide as the
+   largest ball; a tile then only looks at the cells that its area,
+   widened by the largest radius, touches. Each tile writes only its
+   own pixels, so the tiles need no locks.
+
+   The balls are drawn with one pixel of anti-aliasing at the edge,
+   in the order of the grid cells, and blended over a transparent
+   background. The result is a buffer of premultiplied ARGB32 pixels,
+   one row of width() pixels after the other, which is the layout of
+   a Cairo image surface of that format, so that the Renderer can
+   wrap it in one and paint it in one go. The rasterizer itself
+   doesn't need Cairo.
+ */
+class Rasterizer
+{
+public:
+  enum : int { tile_size = 64 };
+
+  Rasterizer()
+    : pool_(new ThreadPool(1)),
+      grid_(),
+      pixels_(),
+      width_(0),
+      height_(0)
+  { }
+
+  void threads(unsigned n)
+  { pool_.reset(new ThreadPool(n)); }
+
+  unsigned threads() const
+  { return pool_->size(); }
+
+  /**
+     Draw the balls into an image of width x height pixels, in which
+     the unit square covers the whole image. The buffer is only
+     reallocated when the size changes.
+   */
+  void render(const Particles &balls, int width, int height)
+  {
+    width  = std::max(width,1);
+    height = std::max(height,1);
+    if (width != width_ || height != height_)
+      {
+        width_  = width;
+        height_ = height;
+        pixels_.assign(std::size_t(width) * height,0);
+      }
+
+    double max_rad = 0.0;
+    for (double rad : balls.rad)
+      max_rad = std::max(max_rad,rad);
+    grid_.build(balls.size(),2 * max_rad,[&balls](std::size_t i) {
+        return Vec2d { balls.x[i], balls.y[i] };
+      });
+
+    const std::size_t tiles_x = (width_ + tile_size - 1) / tile_size;
+    const std::size_t tiles_y = (height_ + tile_size - 1) / tile_size;
+    pool_->parallel_for(tiles_x * tiles_y,1,[&](std::size_t b, std::size_t e, unsigned) {
+        for (std::size_t t = b ; t < e ; ++t)
+          draw_tile(balls,max_rad,int(t % tiles_x) * tile_size,int(t / tiles_x) * tile_size);
+      });
+  }
+
+  /**
+     The image of the most recent render().
+   */
+  std::uint32_t *pixels()
+  { return pixels_.data(); }
+
+  int width() const
+  { return width_; }
+
+  int height() const
+  { return height_; }
+
+private:
+  std::size_t cell(double v) const
+  {
+    const double c = v * grid_.dim();
+    if (!(c > 0))
+      return 0;
+    return std::min<std::size_t>(static_cast<std::size_t>(c),grid_.dim() - 1);
+  }
+
+  void draw_tile(const Particles &balls, double max_rad, int x0, int y0)
+  {
+    const int x1     = std::min(x0 + int(tile_size),width_);
+    const int y1     = std::min(y0 + int(tile_size),height_);
+    const int stride = width_;
+
+    for (int y = y0 ; y < y1 ; ++y)
+      std::fill_n(&pixels_[std::size_t(y) * stride + x0],x1 - x0,0u);
+
+    /* The cells touched by the tile, widened by the largest radius. */
+    const std::size_t cx0 = cell(double(x0) / width_ - max_rad);
+    const std::size_t cx1 = cell(double(x1) / width_ + max_rad);
+    const std::size_t cy0 = cell(double(y0) / height_ - max_rad);
+    const std::size_t cy1 = cell(double(y1) / height_ + max_rad);
+
+    for (std::size_t cy = cy0 ; cy <= cy1 ; ++cy)
+      for (std::size_t cx = cx0 ; cx <= cx1 ; ++cx)
+        grid_.foreach_in_cell(cx,cy,[&](std::size_t i) {
+            draw_ball(balls,i,x0,y0,x1,y1,stride);
+          });
+  }
+
+  /* Draw ball i, clipped to the pixels [x0,x1) x [y0,y1). */
+  void draw_ball(const Particles &balls, std::size_t i,
+                 int x0, int y0, int x1, int y1, int stride)
+  {
+    const double px = balls.x[i] * width_;
+    const double py = balls.y[i] * height_;
+    const double rx = std::max<double>(balls.rad[i] * width_,0.5);
+    const double ry = std::max<double>(balls.rad[i] * height_,0.5);
+
+    const int bx0 = std::max(x0,int(std::floor(px - rx)));
+    const int bx1 = std::min(x1,int(std::ceil(px + rx)) + 1);
+    const int by0 = std::max(y0,int(std::floor(py - ry)));
+    const int by1 = std::min(y1,int(std::ceil(py + ry)) + 1);
+    if (bx0 >= bx1 || by0 >= by1)
+      return;
+
+    const Particles::Cold &cold = balls.cold[i];
+    const std::uint32_t color = 0xff000000u
+      | (channel(cold.color_r) << 16) | (channel(cold.color_g) << 8) | channel(cold.color_b);
+
+    /* Distance from the edge, in pixels, along the shorter radius. */
+    const double r = std::min(rx,ry);
+    for (int y = by0 ; y < by1 ; ++y)
+      {
+        const double dy = (y + 0.5 - py) / ry;
+        std::uint32_t *row = &pixels_[std::size_t(y) * stride];
+        for (int x = bx0 ; x < bx1 ; ++x)
+          {
+            const double dx       = (x + 0.5 - px) / rx;
+            const double coverage = (1.0 - ::sqrt(dx * dx + dy * dy)) * r + 0.5;
+            if (coverage > 0)
+              blend(row[x],color,coverage >= 1 ? 255u : unsigned(coverage * 255));
+          }
+      }
+  }
+
+  static std::uint32_t channel(double c)
+  { return static_cast<std::uint32_t>(std::min(std::max(c,0.0),1.0) * 255 + 0.5); }
+
+  /* dst = color * a + dst * (1 - a), on premultiplied ARGB. */
+  static void blend(std::uint32_t &dst, std::uint32_t color, unsigned a)
+  {
+    const unsigned ia = 255 - a;
+    std::uint32_t out = 0;
+    for (unsigned shift = 0 ; shift < 32 ; shift += 8)
+      {
+        const unsigned s = (color >> shift) & 0xff;
+        const unsigned d = (dst >> shift) & 0xff;
+        out |= std::uint32_t((s * a + d * ia + 127) / 255) << shift;
+      }
+    dst = out;
+  }
+
+  std::unique_ptr<ThreadPool> pool_;
+  UniformGrid                 grid_;
+  std::vector<std::uint32_t>  pixels_;
+  int                         width_;
+  int                         height_;
+};
+
+#endif // GTKMM_EXAMPLE_RASTER_H
@@ -0,0 +1,287 @@
+#ifndef GTKMM_EXAMPLE_RENDERER_H
+#define GTKMM_EXAMPLE_RENDERER_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cairomm/context.h>
+#include <cairomm/surface.h>
+
+#include "./particles.h"
+#include "./sprite_cache.h"
+#include "./raster.h"
+
+/**
+   Draws the balls into a Cairo context that covers width x height
+   pixels.
+
+   The per-ball method sets the color and fills one path for each
+   ball. The batched method (the default) instead sorts the balls
+   into buckets by their color, quantized to color_bits bits per
+   channel, and fills one path per bucket, made of all the balls in
+   it, which saves most of the calls into Cairo. How much time that
+   saves hasn't been measured yet (see bench/draw.cpp and the README).
+
+   The Cairo methods skip balls that are entirely outside of the clip
+   extents of the context, i.e. of the part of the window that is
+   being redrawn. The batched method also draws balls whose radius is
+   smaller than min_pixel_radius as a single pixel instead of an arc.
+   Where balls of different colors overlap, it draws them in the order
+   of their buckets rather than in the order of the balls.
+
+   The sprite method blits a pre-rendered image of each ball from a
+   SpriteCache instead of filling an arc. The sprites are keyed by the
+   color bucket and by the radius in pixels, rounded to a quarter
+   pixel, and each ball is placed on the nearest whole pixel. Balls
+   larger than max_sprite_radius pixels are still drawn as arcs.
+
+   The raster method doesn't draw through Cairo at all: a Rasterizer
+   (raster.h) draws the balls into an image on threads() threads,
+   which is then wrapped in an image surface and painted in one go.
+ */
+class Renderer
+{
+public:
+  enum class Method { per_ball, batched, sprites, raster };
+
+  enum : unsigned { color_bits = 4 };
+
+  static constexpr double min_pixel_radius  = 0.5;
+  static constexpr double max_sprite_radius = 64.0;
+
+  Renderer()
+    : method_(Method::batched),
+      start_(),
+      next_(),
+      order_(),
+      sprites_(),
+      raster_(),
+      raster_surface_(),
+      clip_x0_(0.0),
+      clip_y0_(0.0),
+      clip_x1_(1.0),
+      clip_y1_(1.0)
+  { }
+
+  void method(Method m)
+  { method_ = m; }
+
+  Method method() const
+  { return method_; }
+
+  SpriteCache &sprites()
+  { return sprites_; }
+
+  /**
+     Number of threads of the raster method.
+   */
+  void threads(unsigned n)
+  { raster_.threads(n); }
+
+  unsigned threads() const
+  { return raster_.threads(); }
+
+  void draw(const Cairo::RefPtr<Cairo::Context> &cr,
+            const Particles                     &balls,
+            int                                  width,
+            int                                  height)
+  {
+    /* The clip extents, in units of the window. */
+    double x0, y0, x1, y1;
+    cr->get_clip_extents(x0,y0,x1,y1);
+    clip_x0_ = x0 / std::max(width,1);
+    clip_y0_ = y0 / std::max(height,1);
+    clip_x1_ = x1 / std::max(width,1);
+    clip_y1_ = y1 / std::max(height,1);
+
+    cr->save();
+    if (method_ == Method::raster)
+      {
+        draw_raster(cr,balls,width,height);
+      }
+    else if (method_ == Method::sprites)
+      draw_sprites(cr,balls,width,height);
+    else
+      {
+        cr->scale(width,height);
+        if (method_ == Method::batched)
+          draw_batched(cr,balls,width,height);
+        else
+          draw_per_ball(cr,balls);
+      }
+    cr->restore();
+  }
+
+private:
+  enum : std::size_t { levels = 1u << color_bits, buckets = levels * levels * levels };
+
+  bool visible(const Particles &balls, std::size_t i) const
+  {
+    const double r = balls.rad[i];
+    return (balls.x[i] + r > clip_x0_ && balls.x[i] - r < clip_x1_
+            && balls.y[i] + r > clip_y0_ && balls.y[i] - r < clip_y1_);
+  }
+
+  static std::size_t level(double c)
+  {
+    const double l = c * levels;
+    return (l > 0 ? std::min<std::size_t>(static_cast<std::size_t>(l),levels - 1) : 0);
+  }
+
+  static std::size_t bucket(const Particles::Cold &cold)
+  {
+    return (level(cold.color_r) * levels + level(cold.color_g)) * levels
+      + level(cold.color_b);
+  }
+
+  /* The color at the middle of a bucket. */
+  static void bucket_color(std::size_t b, double &red, double &green, double &blue)
+  {
+    red   = (b / (levels * levels) + 0.5) / levels;
+    green = ((b / levels) % levels + 0.5) / levels;
+    blue  = (b % levels + 0.5) / levels;
+  }
+
+  void draw_per_ball(const Cairo::RefPtr<Cairo::Context> &cr, const Particles &balls)
+  {
+    for (std::size_t i = 0 ; i < balls.size() ; ++i)
+      {
+        if (!visible(balls,i))
+          continue;
+        const Particles::Cold &cold = balls.cold[i];
+        cr->set_source_rgb(cold.color_r,cold.color_g,cold.color_b);
+        cr->arc(balls.x[i],balls.y[i],balls.rad[i],0,2*M_PI);
+        cr->fill();
+      }
+  }
+
+  void draw_batched(const Cairo::RefPtr<Cairo::Context> &cr,
+                    const Particles                     &balls,
+                    int                                  width,
+                    int                                  height)
+  {
+    const std::size_t n = balls.size();
+
+    /* Counting sort of the visible balls by bucket. */
+    start_.assign(buckets + 1,0);
+    for (std::size_t i = 0 ; i < n ; ++i)
+      if (visible(balls,i))
+        ++start_[bucket(balls.cold[i]) + 1];
+    for (std::size_t b = 0 ; b < buckets ; ++b)
+      start_[b + 1] += start_[b];
+    order_.resize(start_[buckets]);
+    next_.assign(start_.begin(),start_.end() - 1);
+    for (std::size_t i = 0 ; i < n ; ++i)
+      if (visible(balls,i))
+        order_[next_[bucket(balls.cold[i])]++] = i;
+
+    /* A ball smaller than this (in units of the window) is a pixel. */
+    const double pixel_x = 1.0 / std::max(width,1);
+    const double pixel_y = 1.0 / std::max(height,1);
+    const double min_rad = min_pixel_radius * std::max(pixel_x,pixel_y);
+
+    for (std::size_t b = 0 ; b < buckets ; ++b)
+      {
+        if (start_[b] == start_[b + 1])
+          continue;
+
+        double red, green, blue;
+        bucket_color(b,red,green,blue);
+        cr->set_source_rgb(red,green,blue);
+
+        for (std::size_t k = start_[b] ; k < start_[b + 1] ; ++k)
+          {
+            const std::size_t i = order_[k];
+            if (balls.rad[i] < min_rad)
+              cr->rectangle(balls.x[i] - pixel_x / 2,balls.y[i] - pixel_y / 2,
+                            pixel_x,pixel_y);
+            else
+              {
+                cr->new_sub_path();
+                cr->arc(balls.x[i],balls.y[i],balls.rad[i],0,2*M_PI);
+              }
+          }
+        cr->fill();
+      }
+  }
+
+  /* The surface wraps the buffer of the rasterizer, so it is made
+     again whenever render() has allocated a new one. */
+  void draw_raster(const Cairo::RefPtr<Cairo::Context> &cr,
+                   const Particles                     &balls,
+                   int                                  width,
+                   int                                  height)
+  {
+    if (raster_surface_)
+      raster_surface_->flush();
+    raster_.render(balls,width,height);
+    unsigned char *data = reinterpret_cast<unsigned char*>(raster_.pixels());
+    if (!raster_surface_ || raster_surface_->get_data() != data
+        || raster_surface_->get_width() != raster_.width()
+        || raster_surface_->get_height() != raster_.height())
+      raster_surface_ = Cairo::ImageSurface::create(data,Cairo::FORMAT_ARGB32,
+                                                    raster_.width(),raster_.height(),
+                                                    4 * raster_.width());
+    raster_surface_->mark_dirty();
+    cr->set_source(raster_surface_,0,0);
+    cr->paint();
+  }
+
+  void draw_sprites(const Cairo::RefPtr<Cairo::Context> &cr,
+                    const Particles                     &balls,
+                    int                                  width,
+                    int                                  height)
+  {
+    sprites_.target(width,height);
+    for (std::size_t i = 0 ; i < balls.size() ; ++i)
+      {
+        if (!visible(balls,i))
+          continue;
+
+        /* Radii in quarter pixels. */
+        const double      rad = balls.rad[i];
+        const std::size_t b   = bucket(balls.cold[i]);
+        const std::uint64_t qx = std::max<long>(1,std::lround(4 * rad * width));
+        const std::uint64_t qy = std::max<long>(1,std::lround(4 * rad * height));
+        const double px = balls.x[i] * width;
+        const double py = balls.y[i] * height;
+
+        double red, green, blue;
+        bucket_color(b,red,green,blue);
+        if (rad * std::max(width,height) > max_sprite_radius)
+          {
+            cr->save();
+            cr->translate(px,py);
+            cr->scale(rad * width,rad * height);
+            cr->arc(0.0,0.0,1.0,0,2*M_PI);
+            cr->restore();
+            cr->set_source_rgb(red,green,blue);
+            cr->fill();
+            continue;
+          }
+
+        const std::uint64_t key = (qx << 32) | (qy << 16) | b;
+        const SpriteCache::Sprite &sprite = sprites_.get(key,qx / 4.0,qy / 4.0,red,green,blue);
+        const double left = std::floor(px - sprite.width / 2.0 + 0.5);
+        const double top  = std::floor(py - sprite.height / 2.0 + 0.5);
+        cr->set_source(sprite.surface,left,top);
+        cr->rectangle(left,top,sprite.width,sprite.height);
+        cr->fill();
+      }
+  }
+
+  Method                             method_;
+  std::vector<std::size_t>           start_;
+  std::vector<std::size_t>           next_;
+  std::vector<std::size_t>           order_;
+  SpriteCache                        sprites_;
+  Rasterizer                         raster_;
+  Cairo::RefPtr<Cairo::ImageSurface> raster_surface_;
+  double                             clip_x0_;
+  double                             clip_y0_;
+  double                             clip_x1_;
+  double                             clip_y1_;
+};
+
+#endif // GTKMM_EXAMPLE_RENDERER_H
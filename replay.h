@@ -0,0 +1,121 @@
+#ifndef GTKMM_EXAMPLE_REPLAY_H
+#define GTKMM_EXAMPLE_REPLAY_H
+
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "./particles.h"
+#include "./trajectory.h"
+
+/**
+   Plays back a recorded trajectory (see trajectory.h) instead of
+   running a simulation.
+
+   The position in the recording is a fractional frame number that
+   advance() moves forward by speed() frames per second of wall-clock
+   time (or backward, for a negative speed). Frames are only decoded
+   when balls() is asked for a frame other than the one decoded last,
+   so the cost of a redraw doesn't depend on how long the recorded
+   run took to simulate, and paused playback costs nothing.
+ */
+class Replay
+{
+public:
+  Replay()
+    : reader_(),
+      position_(0.0),
+      speed_(100.0),
+      paused_(false),
+      decoded_(none),
+      step_(0),
+      balls_()
+  { }
+
+  /**
+     Open a trajectory file and go to its first frame. Returns false
+     if it can't be read.
+   */
+  bool open(const std::string &path)
+  {
+    decoded_  = none;
+    position_ = 0.0;
+    return (reader_.open(path) && reader_.frames() > 0);
+  }
+
+  bool active() const
+  { return reader_.is_open() && reader_.frames() > 0; }
+
+  std::size_t frames() const
+  { return reader_.frames(); }
+
+  std::size_t frame() const
+  { return static_cast<std::size_t>(position_); }
+
+  /**
+     Playback speed in frames per second. The default of 100 plays a
+     recording of every step at the speed of the simulation (one step
+     of Simulation::time_lapse = 10 ms).
+   */
+  void speed(double frames_per_second)
+  { speed_ = frames_per_second; }
+
+  double speed() const
+  { return speed_; }
+
+  void pause(bool paused)
+  { paused_ = paused; }
+
+  bool paused() const
+  { return paused_; }
+
+  /**
+     Move the playback forward by the given wall-clock time. At either
+     end of the recording, the playback stops there.
+   */
+  void advance(double seconds)
+  {
+    if (!paused_)
+      seek(position_ + speed_ * seconds);
+  }
+
+  /**
+     Go to the given frame, clamped to the recording.
+   */
+  void seek(double frame)
+  {
+    const double last = (frames() > 0 ? double(frames() - 1) : 0.0);
+    position_ = std::min(std::max(frame,0.0),last);
+  }
+
+  /**
+     The balls at the current frame.
+   */
+  const Particles &balls()
+  {
+    if (frame() != decoded_ && reader_.read(frame(),balls_,&step_))
+      decoded_ = frame();
+    return balls_;
+  }
+
+  /**
+     The step of the simulation the current frame was recorded at, as
+     of the last call of balls().
+   */
+  unsigned long step() const
+  { return step_; }
+
+private:
+  enum : std::size_t { none = static_cast<std::size_t>(-1) };
+
+  TrajectoryReader reader_;
+  double           position_;
+  double           speed_;
+  bool             paused_;
+  std::size_t      decoded_;
+  unsigned long    step_;
+  Particles        balls_;
+};
+
+#endif // GTKMM_EXAMPLE_REPLAY_H
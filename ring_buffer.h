@@ -0,0 +1,94 @@
+#ifndef GTKMM_EXAMPLE_RING_BUFFER_H
+#define GTKMM_EXAMPLE_RING_BUFFER_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+/**
+   Lock-free ring buffer of a fixed number of slots, for handing a
+   queue of values from one producer thread to one consumer thread.
+
+   Unlike TripleBuffer (triple_buffer.h), which only keeps the newest
+   value, this keeps every value until the consumer has taken it.
+
+   The producer takes a free slot with claim(), fills it and hands it
+   over with push(). The consumer looks at the oldest value with
+   front() and frees its slot with pop(). The slots are reused, so a
+   T that keeps its capacity on assignment doesn't allocate once the
+   ring has gone around.
+ */
+template <class T>
+class RingBuffer
+{
+public:
+  explicit RingBuffer(std::size_t capacity)
+    : slots_(capacity + 1),
+      head_(0),
+      tail_(0)
+  { }
+
+  RingBuffer(const RingBuffer &) = delete;
+  RingBuffer &operator=(const RingBuffer &) = delete;
+
+  std::size_t capacity() const
+  { return slots_.size() - 1; }
+
+  /**
+     A free slot for the producer to fill, or nullptr if the ring is
+     full.
+   */
+  T *claim()
+  {
+    const std::size_t tail = tail_.load(std::memory_order_relaxed);
+    if (next(tail) == head_.load(std::memory_order_acquire))
+      return nullptr;
+    return &slots_[tail];
+  }
+
+  /**
+     Hand the slot returned by claim() to the consumer.
+   */
+  void push()
+  {
+    const std::size_t tail = tail_.load(std::memory_order_relaxed);
+    tail_.store(next(tail),std::memory_order_release);
+  }
+
+  /**
+     The oldest value not yet taken by the consumer, or nullptr if
+     there is none.
+   */
+  T *front()
+  {
+    const std::size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire))
+      return nullptr;
+    return &slots_[head];
+  }
+
+  /**
+     Give the slot returned by front() back to the producer.
+   */
+  void pop()
+  {
+    const std::size_t head = head_.load(std::memory_order_relaxed);
+    head_.store(next(head),std::memory_order_release);
+  }
+
+  bool empty() const
+  {
+    return (head_.load(std::memory_order_acquire)
+            == tail_.load(std::memory_order_acquire));
+  }
+
+private:
+  std::size_t next(std::size_t i) const
+  { return (i + 1 == slots_.size() ? 0 : i + 1); }
+
+  std::vector<T>           slots_;
+  std::atomic<std::size_t> head_;
+  std::atomic<std::size_t> tail_;
+};
+
+#endif // GTKMM_EXAMPLE_RING_BUFFER_H
@@ -0,0 +1,1478 @@
+#ifndef GTKMM_EXAMPLE_SIMULATION_H
+#define GTKMM_EXAMPLE_SIMULATION_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <cstdint>
+
+#include "./vec.h"
+#include "./particles.h"
+#include "./grid.h"
+#include "./neighbor_list.h"
+#include "./barnes_hut.h"
+#include "./particle_mesh.h"
+#include "./kernels.h"
+#include "./thread_pool.h"
+#include "./event_driven.h"
+#include "./profiler.h"
+#include "./checkpoint.h"
+#include "./arena.h"
+
+/**
+   The physics of the balls, without any drawing. Balls (balls.h)
+   shows a Simulation in a GTK window; the headless program
+   (headless.cpp) runs one without a display.
+
+   The scratch data of a step (lists of neighbors, velocity changes)
+   lives in arenas (arena.h), one per thread, which are reset at the
+   end of each step. The grid, the quadtree and the event queue keep
+   the capacity of their buffers from one step to the next. Once
+   these have grown to the size the steps need, a step doesn't call
+   the global allocator any more (headless --check-alloc checks this).
+ */
+class Simulation
+{
+public:
+  using seed_type = std::random_device::result_type;
+
+  static constexpr int time_lapse = 10;
+
+  /**
+     How candidate pairs for ball-ball collisions are found. The
+     all-pairs method tests every pair; the uniform grid only tests
+     balls in the same or in adjacent cells. The neighbor list keeps
+     the pairs closer than the skin (see neighbor_skin()) from one
+     step to the next, and keeps the cooldown of a collision per pair
+     rather than per ball. It only pays off without gravity: with it,
+     the balls move further than the skin in every step, and the list
+     is built in every step, which costs more than the grid.
+
+     All three find the same overlapping pairs, but the all-pairs
+     loop resolves them in the order of the balls, the other two tile
+     by tile (see foreach_tile()), so where a ball touches several
+     others at once their results differ a little.
+   */
+  enum class BroadPhase { all_pairs, uniform_grid, neighbor_list };
+
+  /**
+     How the gravity pass is computed: exactly over all pairs, or
+     approximately with a Barnes–Hut quadtree; or not at all. The
+     particle-mesh method solves for the field on a mesh by FFT (see
+     particle_mesh.h); it smooths out the pull between balls closer
+     than a few cells, which is most of it once the balls touch. The
+     cutoff method adds that pull back: it sums the pairs closer than
+     cutoff_radius() exactly, over the 3x3 cells around each ball of a
+     UniformGrid with cells that wide, and takes only the rest, which
+     varies slowly, from the mesh (P3M). The radius is set in cells of
+     the mesh, so a finer mesh makes the exact part cheaper.
+   */
+  enum class Gravity { pairwise, barnes_hut, none, particle_mesh, cutoff };
+
+  /**
+     How the balls are moved. Time stepping moves all balls by their
+     velocity and then resolves overlaps (see collisions()). The
+     event-driven engine (see event_driven.h) moves from one exact
+     collision time to the next. With it, gravity is applied as a kick
+     at the end of each step, after which all collision times have to
+     be predicted again; it works best with Gravity::none.
+   */
+  enum class Integrator { time_stepping, event_driven };
+
+  /**
+     How time stepping moves the balls under gravity. Euler moves the
+     balls by their velocity and then kicks them with the gravity at
+     their new positions (semi-implicit Euler, first order). Velocity
+     Verlet (leapfrog in kick-drift-kick form) kicks them by half a
+     step before and after the move; it is symplectic and second
+     order, at one gravity pass per step, since the gravity at the end
+     of a step is kept for the start of the next. RK4 is the classical
+     fourth-order Runge–Kutta method, at four gravity passes per step;
+     its error per step is much smaller, but it isn't symplectic, so
+     the energy still drifts slowly. In all three, the walls and the
+     collisions are resolved after the move. Without gravity, they are
+     the same.
+   */
+  enum class Scheme { euler, verlet, rk4 };
+
+  /**
+     Kinetic and potential energy of the balls, per unit of mass (see
+     energy()).
+   */
+  struct Energy
+  {
+    double kinetic;
+    double potential;
+
+    double total() const
+    { return kinetic + potential; }
+  };
+
+  static constexpr double gravity_constant = 0.00001;
+
+  /**
+     When the Barnes–Hut solver is used, its error against the
+     pairwise kernel is measured every this many steps.
+   */
+  static constexpr unsigned gravity_error_interval = 100;
+  static constexpr unsigned gravity_error_samples  = 256;
+
+  /**
+     Number of balls per chunk in the parallel loops of the step, and
+     number of rows per chunk of the pairwise gravity pass.
+   */
+  static constexpr std::size_t chunk_size   = 4096;
+  static constexpr std::size_t gravity_rows = 16;
+
+  /**
+     Default range of the exact part of the cutoff method, in cells of
+     the mesh.
+   */
+  static constexpr double default_cutoff_cells = 4.0;
+
+  /**
+     Default number of steps between two spatial sorts of the balls
+     (see sort_spatially()).
+   */
+  static constexpr unsigned default_sort_interval = 64;
+
+  /**
+     Largest number of substeps a step is cut into by adaptive
+     substepping (see adaptive()).
+   */
+  static constexpr unsigned max_substeps = 64;
+
+  /**
+     Default skin of the neighbor list (see neighbor_skin()).
+   */
+  static constexpr double default_skin = 0.5;
+
+  /**
+     A group of balls that pulls as one, at its center of mass, with
+     the total mass and the number of its balls (see far_field()).
+   */
+  struct PseudoBall
+  {
+    Vec2d  com;
+    double mass;
+    double count;
+  };
+
+  Ball random_ball()
+  {
+    static std::uniform_real_distribution<double> pos_dist(0,1);
+    static std::uniform_real_distribution<double> speed_dist(0.000001,0.00003);
+    static std::normal_distribution<double>       mass_dist(0.05,0.0);
+
+    return {
+        { pos_dist(rand_), pos_dist(rand_) },
+        { speed_dist(rand_), speed_dist(rand_) },
+          std::abs(mass_dist(rand_)),
+        pos_dist(rand_),pos_dist(rand_),pos_dist(rand_)
+    };
+  }
+
+
+  Simulation(seed_type   seed,
+             std::size_t n_balls     = 10,
+             BroadPhase  broad_phase = BroadPhase::uniform_grid,
+             Gravity     gravity     = Gravity::pairwise,
+             double      theta       = 0.5)
+    : rand_(seed),
+      balls_(),
+      broad_phase_(broad_phase),
+      grid_(),
+      contacts_(0),
+      gravity_(gravity),
+      tree_(theta),
+      mesh_(),
+      near_(),
+      cutoff_cells_(default_cutoff_cells),
+      steps_(0),
+      gravity_error_(0.0),
+      kernels_(&best_kernels()),
+      arena_(),
+      pool_(new ThreadPool(1)),
+      scratch_(1),
+      worker_contacts_(1),
+      worker_ghost_ends_(1),
+      ghost_ends_(0),
+      integrator_(Integrator::time_stepping),
+      events_(),
+      worker_pairs_(1),
+      profiler_(),
+      sort_interval_(default_sort_interval),
+      scheme_(Scheme::euler),
+      courant_(0.0),
+      substeps_(1),
+      accel_valid_(false),
+      ax_(),
+      ay_(),
+      sleep_speed_(0.0),
+      sleep_steps_(0),
+      awake_(0),
+      neighbors_(),
+      skin_(default_skin),
+      ghosts_(0),
+      far_()
+  {
+    balls_.reserve(n_balls + 1);
+    for (std::size_t i = 0 ; i < n_balls ; ++i)
+      balls_.push_back(random_ball());
+    balls_.push_back(Ball { {0.5,0.5},{0.0,0.0},0.2,0.1,0.1,0.1 } );
+    awake_ = balls_.size();
+  }
+
+  const Particles &balls() const
+  { return balls_; }
+
+  /**
+     Replace all balls, e.g. by ones from another distribution than
+     random_ball().
+   */
+  void balls(Particles balls)
+  {
+    balls_  = std::move(balls);
+    awake_  = balls_.size();
+    ghosts_ = 0;
+    events_.invalidate();
+    neighbors_.invalidate();
+    accel_valid_ = false;
+  }
+
+  /**
+     Copy the state into a checkpoint (see checkpoint.h), reusing its
+     buffers.
+   */
+  void save(Checkpoint &state) const
+  {
+    state.rng.clear();
+    checkpoint_format::StringAppender buf(state.rng);
+    std::ostream rng(&buf);
+    rng << rand_;
+    state.balls = balls_;
+    state.steps = steps_;
+  }
+
+  /**
+     Continue from a checkpoint. The balls are taken over from it, so
+     it is left empty. The settings (broad phase, gravity, threads,
+     etc.) are not part of a checkpoint and stay as they are.
+
+     With the same settings, the run goes on as if it had never been
+     interrupted, but only with time stepping and the all-pairs or
+     grid broad phase. The event queue of the event-driven integrator
+     (with its clock) and the neighbor list (with the cooldowns of its
+     pairs) are not saved, but started afresh from the balls, which
+     changes the times and the order of the collisions a little.
+   */
+  void restore(Checkpoint &&state)
+  {
+    std::istringstream rng(state.rng);
+    rng >> rand_;
+    balls_ = std::move(state.balls);
+    steps_  = state.steps;
+    awake_  = balls_.size();
+    ghosts_ = 0;
+    events_.invalidate();
+    neighbors_.invalidate();
+    accel_valid_ = false;
+  }
+
+  /**
+     Number of steps done so far.
+   */
+  unsigned long steps() const
+  { return steps_; }
+
+  void broad_phase(BroadPhase method)
+  { broad_phase_ = method; }
+
+  BroadPhase broad_phase() const
+  { return broad_phase_; }
+
+  /**
+     How much further apart than touching two balls may be for the
+     neighbor list to keep their pair, in units of the largest radius.
+     The list is built again when a ball has moved further than half
+     of it, so a larger skin means more pairs to test, but fewer
+     builds.
+   */
+  void neighbor_skin(double skin)
+  { skin_ = skin; }
+
+  double neighbor_skin() const
+  { return skin_; }
+
+  const NeighborList &neighbor_list() const
+  { return neighbors_; }
+
+  /**
+     Take the last n balls as ghosts: copies of balls that belong to
+     another domain of a distributed run (see domain.h). They move and
+     collide like the others, but sort_spatially() keeps them at the
+     end, so that they can be told apart after the step. balls()
+     resets this to 0. Ghosts don't work with sleep().
+   */
+  void ghosts(std::size_t n)
+  { ghosts_ = std::min(n,balls_.size()); }
+
+  std::size_t ghosts() const
+  { return ghosts_; }
+
+  /**
+     Pseudo-balls that pull on the balls besides the balls themselves,
+     as a Barnes–Hut cell does (see barnes_hut.h), e.g. the balls of
+     the other domains of a distributed run. Their pull is added by
+     every gravity method except none, and they don't move. They are
+     left out of energy().
+   */
+  void far_field(const std::vector<PseudoBall> &bodies)
+  { far_.assign(bodies.begin(),bodies.end()); }
+
+  const std::vector<PseudoBall> &far_field() const
+  { return far_; }
+
+  /**
+     Number of ball-ball contacts resolved in the most recent step.
+   */
+  std::size_t contacts() const
+  { return contacts_; }
+
+  /**
+     The contacts of the most recent step as they add up over the
+     domains of a distributed run (see domain.h): a contact between a
+     ball and a ghost is found on both sides of the boundary, so it
+     counts as half, and one between two ghosts is counted where the
+     balls belong, so it doesn't count here. Without ghosts, this is
+     contacts().
+   */
+  double own_contacts() const
+  { return contacts_ - 0.5 * ghost_ends_; }
+
+  void gravity(Gravity method)
+  {
+    gravity_     = method;
+    accel_valid_ = false;
+  }
+
+  Gravity gravity() const
+  { return gravity_; }
+
+  void theta(double t)
+  { tree_.theta(t); }
+
+  /**
+     Choose the set of vectorized kernels (see kernels.h). The default
+     is the best one the CPU supports.
+   */
+  void kernels(const Kernels &k)
+  { kernels_ = &k; }
+
+  const Kernels &kernels() const
+  { return *kernels_; }
+
+  /**
+     Number of threads the physics step runs on. The result does not
+     depend on it: every parallel pass either writes disjoint data or
+     adds up its parts in a fixed order, and the collisions are
+     resolved tile by tile in the same order with any number of
+     threads (see foreach_tile()).
+   */
+  void threads(unsigned n)
+  {
+    pool_.reset(new ThreadPool(n));
+    scratch_.resize(pool_->size());
+    worker_contacts_.resize(pool_->size());
+    worker_ghost_ends_.resize(pool_->size());
+    worker_pairs_.resize(pool_->size());
+  }
+
+  unsigned threads() const
+  { return pool_->size(); }
+
+  void integrator(Integrator method)
+  {
+    integrator_ = method;
+    events_.invalidate();
+  }
+
+  Integrator integrator() const
+  { return integrator_; }
+
+  /**
+     Number of steps between two calls of sort_spatially() by step(),
+     or 0 to never sort. Only the time-stepping integrator sorts;
+     the event-driven engine would have to predict all events again.
+   */
+  void sort_interval(unsigned steps)
+  { sort_interval_ = steps; }
+
+  unsigned sort_interval() const
+  { return sort_interval_; }
+
+  void scheme(Scheme method)
+  {
+    scheme_      = method;
+    accel_valid_ = false;
+  }
+
+  Scheme scheme() const
+  { return scheme_; }
+
+  /**
+     Adaptive substepping for time stepping: each step is cut into as
+     many substeps as it takes for no ball to move further than
+     courant times the smallest radius in one of them (but at most
+     max_substeps), so that fast balls don't pass through each other
+     and the gravity of close encounters is resolved. 0 turns it off.
+   */
+  void adaptive(double courant)
+  { courant_ = courant; }
+
+  double adaptive() const
+  { return courant_; }
+
+  /**
+     Let balls fall asleep: a ball that has been slower than speed
+     (in units per ms) for steps steps in a row stops, and is skipped
+     by the integration, the walls, the gravity kicks and, as the
+     first ball of a pair, the broad phase, until a ball hits it
+     faster than speed. Until then, it is an immovable obstacle to the
+     balls that touch it. The sleeping balls are kept after the awake
+     ones (see awake()); the other balls keep their order. 0 steps
+     turns it off (the default). Only time stepping puts balls to
+     sleep.
+   */
+  void sleep(double speed, unsigned steps)
+  {
+    sleep_speed_ = speed;
+    sleep_steps_ = steps;
+    if (steps == 0)
+      for (auto &cold : balls_.cold)
+        cold.calm = 0;
+  }
+
+  double sleep_speed() const
+  { return sleep_speed_; }
+
+  unsigned sleep_steps() const
+  { return sleep_steps_; }
+
+  /**
+     Number of awake balls; they come first.
+   */
+  std::size_t awake() const
+  { return awake_; }
+
+  /**
+     Number of substeps the most recent step was cut into.
+   */
+  unsigned last_substeps() const
+  { return substeps_; }
+
+  /**
+     The event-driven engine, e.g. to read its counters.
+   */
+  const EventDrivenEngine &event_engine() const
+  { return events_; }
+
+  /**
+     Timings and counters of the recent steps. They are only recorded
+     when compiled with SIMUL_PROFILE (see profiler.h).
+   */
+  Profiler &profiler()
+  { return profiler_; }
+
+  const Profiler &profiler() const
+  { return profiler_; }
+
+  double theta() const
+  { return tree_.theta(); }
+
+  /**
+     Number of cells along a side of the mesh of the particle-mesh
+     method, rounded up to a power of two.
+   */
+  void mesh_size(std::size_t cells)
+  { mesh_.size(cells); }
+
+  std::size_t mesh_size() const
+  { return mesh_.size(); }
+
+  /**
+     Range of the pairs that the cutoff method sums exactly, in cells
+     of the mesh. A few cells are enough for the mesh to carry the
+     rest of the pull, which varies slowly at that scale; the exact
+     part costs about n² cutoff_radius()² pairs.
+   */
+  void cutoff_cells(double cells)
+  { cutoff_cells_ = cells; }
+
+  double cutoff_cells() const
+  { return cutoff_cells_; }
+
+  double cutoff_radius() const
+  { return cutoff_cells_ / mesh_.size(); }
+
+  /**
+     Whether the gravity method only approximates the pairwise one.
+   */
+  bool approximate() const
+  { return gravity_ != Gravity::pairwise && gravity_ != Gravity::none; }
+
+  /**
+     The error of the approximate gravity method as last measured
+     during a step (see gravity_error_interval).
+   */
+  double last_gravity_error() const
+  { return gravity_error_; }
+
+  /**
+     Relative RMS error of the velocity changes of the approximate
+     gravity method against those of the exact pairwise kernel, for
+     the current state:
+
+       sqrt( sum |dv_approx - dv_exact|² / sum |dv_exact|² )
+
+     The sums run over an evenly spaced sample of at most
+     gravity_error_samples balls, so the cost is that of one pass of
+     the approximate method, plus linear in the number of balls. It is
+     0 for the exact method.
+   */
+  double gravity_error()
+  {
+    const std::size_t n      = balls_.size();
+    const std::size_t stride = std::max<std::size_t>(1,n / gravity_error_samples);
+    if (!approximate())
+      return 0.0;
+
+    const Arena::Mark mark = arena_.mark();
+    real *const dvx = arena_.allocate<real>(n);
+    real *const dvy = arena_.allocate<real>(n);
+    field(balls_.x.data(),balls_.y.data(),dvx,dvy,n);
+
+    double sqr_err = 0.0;
+    double sqr_ref = 0.0;
+    const real *const p[] = { balls_.x.data(), balls_.y.data() };
+    for (std::size_t i = 0 ; i < n ; i += stride)
+      {
+        real dv[2];
+        real *const out[] = { &dv[0], &dv[1] };
+        kernels_->gravity(p,balls_.m.data(),n,i,i+1,gravity_constant,out);
+        const Vec2d exact = Vec2d { dv[0], dv[1] } + far_pull(i,balls_.x[i],balls_.y[i]);
+        sqr_err += norm(Vec2d { dvx[i], dvy[i] } - exact);
+        sqr_ref += norm(exact);
+      }
+    arena_.rewind(mark);
+    return (sqr_ref > 0 ? ::sqrt(sqr_err / sqr_ref) : 0.0);
+  }
+
+  /**
+     The energy that the gravity pass conserves, in (unit/ms)², to
+     check how well an integration scheme keeps it.
+
+     Ball j changes the velocity of ball i by G (m_i + m_j) d / r² per
+     step of time_lapse (see kernels.h), d = p_i - p_j, r = |d|, which
+     is the same for all balls at the same spot, whatever their mass.
+     The quantity conserved by this is
+
+       sum_i |v_i|² / 2 - G / time_lapse sum_i<j (m_i + m_j) ln r_ij
+
+     which for balls of equal mass m is their energy divided by m.
+     Collisions conserve it between balls of equal mass only, and the
+     walls and collisions change it where they push balls back or
+     apart, so it is exactly conserved only without contacts. The
+     potential is summed over all pairs, in parallel. The far field
+     is left out.
+   */
+  Energy energy()
+  {
+    const std::size_t n = balls_.size();
+    Energy result { 0.0, 0.0 };
+    for (std::size_t i = 0 ; i < n ; ++i)
+      result.kinetic += 0.5 * (sqr(double(balls_.vx[i])) + sqr(double(balls_.vy[i])));
+    if (gravity_ == Gravity::none)
+      return result;
+
+    /* The rows are summed separately and added up in order, so that
+       the result doesn't depend on the number of threads. */
+    const Arena::Mark mark = arena_.mark();
+    double *const rows = arena_.allocate<double>(n);
+    pool_->parallel_for(n,gravity_rows,[this,n,rows](std::size_t b, std::size_t e, unsigned) {
+        for (std::size_t i = b ; i < e ; ++i)
+          {
+            double sum = 0.0;
+            for (std::size_t j = i + 1 ; j < n ; ++j)
+              {
+                const double r2 = sqr(double(balls_.x[i]) - balls_.x[j])
+                  + sqr(double(balls_.y[i]) - balls_.y[j]);
+                if (r2 > 0)
+                  sum += (double(balls_.m[i]) + balls_.m[j]) * 0.5 * ::log(r2);
+              }
+            rows[i] = sum;
+          }
+      });
+    for (std::size_t i = 0 ; i < n ; ++i)
+      result.potential += rows[i];
+    result.potential *= -gravity_constant / time_lapse;
+    arena_.rewind(mark);
+    return result;
+  }
+
+  /**
+     One step of the simulation, advancing it by dt milliseconds
+     (time_lapse by default; a smaller dt is a substep). The phases of
+     the step are public too, so that they can be timed separately.
+   */
+  void step(double dt = time_lapse)
+  {
+    if (integrator_ == Integrator::time_stepping
+        && sort_interval_ > 0 && steps_ % sort_interval_ == 0)
+      sort_spatially();
+    if (integrator_ == Integrator::time_stepping)
+      partition_sleeping();
+    else
+      awake_ = balls_.size();
+    if (approximate() && steps_ % gravity_error_interval == 0)
+      gravity_error_ = gravity_error();
+
+    if (integrator_ == Integrator::event_driven)
+      {
+        {
+          SIMUL_PROFILE_SCOPE(profiler_,Profiler::collisions);
+          SIMUL_PROFILE_ONLY(const unsigned long predictions = events_.predictions();)
+          contacts_ = events_.advance(balls_,dt,balls_.size() - ghosts_,ghost_ends_);
+          SIMUL_PROFILE_ONLY(profiler_.count(Profiler::pairs,events_.predictions() - predictions);
+                             profiler_.count(Profiler::contacts,contacts_);)
+        }
+        if (gravity_ != Gravity::none)
+          {
+            gravitation(dt);
+            events_.invalidate();
+          }
+      }
+    else
+      {
+        /* The contacts are counted over all substeps. */
+        std::size_t contacts   = 0;
+        std::size_t ghost_ends = 0;
+        substeps_ = substeps_for(dt);
+        for (unsigned s = 0 ; s < substeps_ ; ++s)
+          {
+            advance(dt / substeps_);
+            contacts   += contacts_;
+            ghost_ends += ghost_ends_;
+          }
+        contacts_   = contacts;
+        ghost_ends_ = ghost_ends;
+        settle();
+      }
+    SIMUL_PROFILE_ONLY(profiler_.count(Profiler::awake,awake_);)
+    arena_.reset();
+    for (Arena &scratch : scratch_)
+      scratch.reset();
+    ++steps_;
+    SIMUL_PROFILE_ONLY(profiler_.end_step();)
+  }
+
+  /**
+     Reorder the balls along a Morton (Z-order) curve over the unit
+     square, so that balls close to each other in space are mostly
+     close to each other in memory too. The cells of the grid, the
+     leaves of the quadtree and the tiles of the parallel collisions
+     then touch far fewer cache lines. Balls keep their ids (see
+     Particles), so only the order of the pairs tested changes. The
+     ghosts stay at the end, in their order.
+   */
+  void sort_spatially()
+  {
+    const std::size_t n     = balls_.size();
+    const std::size_t owned = n - ghosts_;
+    const Arena::Mark mark = arena_.mark();
+    std::uint64_t *keys  = arena_.allocate<std::uint64_t>(owned);
+    std::size_t   *order = arena_.allocate<std::size_t>(n);
+
+    /* The Morton code goes to the upper 32 bits, the index to the
+       lower ones, which also makes the sort stable. */
+    for (std::size_t i = 0 ; i < owned ; ++i)
+      keys[i] = (std::uint64_t(morton(balls_.x[i],balls_.y[i])) << 32) | i;
+    std::sort(keys,keys + owned);
+    for (std::size_t k = 0 ; k < owned ; ++k)
+      order[k] = static_cast<std::size_t>(keys[k] & 0xffffffffu);
+    for (std::size_t k = owned ; k < n ; ++k)
+      order[k] = k;
+
+    /* The gravity kept by velocity Verlet goes along (before
+       permute(), which overwrites order). */
+    if (accel_valid_ && ax_.size() == n)
+      {
+        real *const moved = arena_.allocate<real>(n);
+        for (std::vector<real> *a : { &ax_, &ay_ })
+          {
+            for (std::size_t k = 0 ; k < n ; ++k)
+              moved[k] = (*a)[order[k]];
+            std::copy(moved,moved + n,a->begin());
+          }
+      }
+    balls_.permute(order);
+    events_.invalidate();
+    neighbors_.invalidate();
+    arena_.rewind(mark);
+  }
+
+  /**
+     Number of substeps step(dt) cuts a step into (see adaptive()).
+   */
+  unsigned substeps_for(double dt) const
+  {
+    if (!(courant_ > 0) || balls_.size() == 0)
+      return 1;
+
+    double max_sqr_v = 0.0;
+    double min_rad   = std::numeric_limits<double>::max();
+    for (std::size_t i = 0 ; i < balls_.size() ; ++i)
+      {
+        max_sqr_v = std::max<double>(max_sqr_v,sqr(balls_.vx[i]) + sqr(balls_.vy[i]));
+        min_rad   = std::min<double>(min_rad,balls_.rad[i]);
+      }
+    const double reach = ::sqrt(max_sqr_v) * dt;
+    const double limit = courant_ * min_rad;
+    if (!(reach > limit))
+      return 1;
+    return static_cast<unsigned>(std::min<double>(max_substeps,std::ceil(reach / limit)));
+  }
+
+  void integrate(double dt = time_lapse)
+  {
+    SIMUL_PROFILE_SCOPE(profiler_,Profiler::integrate);
+    pool_->parallel_for(awake_,chunk_size,
+                        [this,dt](std::size_t b, std::size_t e, unsigned) {
+        kernels_->integrate(balls_.x.data() + b,balls_.vx.data() + b,e - b,dt);
+        kernels_->integrate(balls_.y.data() + b,balls_.vy.data() + b,e - b,dt);
+      });
+  }
+
+  void walls()
+  {
+    using std::numeric_limits;
+    static const real eps = numeric_limits<real>::epsilon();
+    SIMUL_PROFILE_SCOPE(profiler_,Profiler::walls);
+
+    pool_->parallel_for(awake_,chunk_size,[this](std::size_t b, std::size_t e, unsigned) {
+        for (std::size_t i = b ; i < e ; ++i)
+          {
+            auto &cold = balls_.cold[i];
+            if (cold.recent_collision.second > 0)
+              --cold.recent_collision.second;
+            if (cold.recent_collision.second == 0)
+              cold.recent_collision.first = Particles::none;
+          }
+
+        /* Check for collisions with wall. */
+        kernels_->walls(balls_.x.data() + b,balls_.vx.data() + b,
+                        balls_.rad.data() + b,e - b,eps);
+        kernels_->walls(balls_.y.data() + b,balls_.vy.data() + b,
+                        balls_.rad.data() + b,e - b,eps);
+      });
+  }
+
+  void collisions()
+  {
+    const std::size_t n = balls_.size();
+    SIMUL_PROFILE_SCOPE(profiler_,Profiler::collisions);
+
+    contacts_   = 0;
+    ghost_ends_ = 0;
+    if (broad_phase_ == BroadPhase::all_pairs)
+      {
+        for (std::size_t i = 0 ; i < awake_ ; ++i)
+          for (std::size_t j = i + 1 ; j < n ; ++j)
+            if (collide(i,j))
+              {
+                ++contacts_;
+                ghost_ends_ += ghost_ends(i,j);
+              }
+        SIMUL_PROFILE_ONLY(profiler_.count(Profiler::pairs,awake_ * (2 * n - awake_ - 1) / 2);)
+      }
+    else if (broad_phase_ == BroadPhase::uniform_grid)
+      grid_collisions();
+    else
+      list_collisions();
+    SIMUL_PROFILE_ONLY(profiler_.count(Profiler::contacts,contacts_);)
+  }
+
+  /**
+     Effects of gravity. The velocity changes are computed first and
+     added afterwards, so that the rows can be done in parallel and in
+     any order. The changes are those of a full step of time_lapse,
+     scaled down for a substep.
+   */
+  void gravitation(double dt = time_lapse)
+  {
+    const std::size_t n = balls_.size();
+    if (gravity_ == Gravity::none)
+      return;
+    SIMUL_PROFILE_SCOPE(profiler_,Profiler::gravity);
+
+    const Arena::Mark mark = arena_.mark();
+    real *const dvx = arena_.allocate<real>(n);
+    real *const dvy = arena_.allocate<real>(n);
+    field(balls_.x.data(),balls_.y.data(),dvx,dvy,awake_);
+    kick(dvx,dvy,dt);
+    arena_.rewind(mark);
+  }
+
+private:
+  /* The bits of v, spread out to the even bits. */
+  static std::uint32_t spread(std::uint32_t v)
+  {
+    v = (v | (v << 8)) & 0x00ff00ffu;
+    v = (v | (v << 4)) & 0x0f0f0f0fu;
+    v = (v | (v << 2)) & 0x33333333u;
+    v = (v | (v << 1)) & 0x55555555u;
+    return v;
+  }
+
+  /* Morton code of a position, at 16 bits per coordinate. */
+  static std::uint32_t morton(double x, double y)
+  {
+    const double scale = 65535.0;
+    const std::uint32_t qx = static_cast<std::uint32_t>(std::min(std::max(x,0.0),1.0) * scale);
+    const std::uint32_t qy = static_cast<std::uint32_t>(std::min(std::max(y,0.0),1.0) * scale);
+    return spread(qx) | (spread(qy) << 1);
+  }
+
+  /* The grid of the collisions, at the positions x, y. */
+  void build_grid(const real *x, const real *y)
+  {
+    double max_rad = 0.0;
+    for (double rad : balls_.rad)
+      max_rad = std::max(max_rad,rad);
+
+    grid_.build(balls_.size(),2 * max_rad,[x,y](std::size_t i) {
+        return Vec2d { x[i], y[i] };
+      });
+  }
+
+  void build_tree(const real *x, const real *y)
+  {
+    tree_.build(balls_.size(),
+                [x,y](std::size_t i) { return Vec2d { x[i], y[i] }; },
+                [this](std::size_t i) { return balls_.m[i]; });
+  }
+
+  /**
+     Move the sleeping balls after the awake ones, keeping the order
+     within both, and set awake_. The balls are only moved if a ball
+     has woken up or fallen asleep out of order.
+   */
+  void partition_sleeping()
+  {
+    const std::size_t n = balls_.size();
+    std::size_t awake = n;
+    if (sleep_steps_ > 0)
+      {
+        awake = 0;
+        bool sorted = true;
+        for (std::size_t i = 0 ; i < n ; ++i)
+          if (balls_.cold[i].calm < sleep_steps_)
+            {
+              sorted = sorted && (awake == i);
+              ++awake;
+            }
+
+        if (!sorted)
+          {
+            const Arena::Mark mark = arena_.mark();
+            std::size_t *order = arena_.allocate<std::size_t>(n);
+            std::size_t next_awake  = 0;
+            std::size_t next_asleep = awake;
+            for (std::size_t i = 0 ; i < n ; ++i)
+              order[balls_.cold[i].calm < sleep_steps_ ? next_awake++ : next_asleep++] = i;
+            balls_.permute(order);
+            events_.invalidate();
+            neighbors_.invalidate();
+            arena_.rewind(mark);
+          }
+      }
+
+    /* The gravity kept by velocity Verlet is only there for the
+       balls that were awake. */
+    if (awake != awake_)
+      accel_valid_ = false;
+    awake_ = awake;
+  }
+
+  /* Count the steps the awake balls have been slow, and stop those
+     that have been slow for long enough. */
+  void settle()
+  {
+    if (sleep_steps_ == 0)
+      return;
+
+    const double sqr_speed = sqr(sleep_speed_);
+    pool_->parallel_for(awake_,chunk_size,[this,sqr_speed](std::size_t b, std::size_t e, unsigned) {
+        for (std::size_t i = b ; i < e ; ++i)
+          {
+            auto &cold = balls_.cold[i];
+            if (sqr(balls_.vx[i]) + sqr(balls_.vy[i]) >= sqr_speed)
+              cold.calm = 0;
+            else if (++cold.calm >= sleep_steps_)
+              {
+                balls_.vx[i] = 0;
+                balls_.vy[i] = 0;
+                cold.recent_collision.first  = Particles::none;
+                cold.recent_collision.second = 0;
+              }
+          }
+      });
+  }
+
+  /* One substep of time stepping, of dt milliseconds. */
+  void advance(double dt)
+  {
+    if (gravity_ == Gravity::none || scheme_ == Scheme::euler)
+      {
+        integrate(dt);
+        walls();
+        collisions();
+        gravitation(dt);
+      }
+    else if (scheme_ == Scheme::verlet)
+      verlet(dt);
+    else
+      {
+        rk4(dt);
+        walls();
+        collisions();
+      }
+  }
+
+  /**
+     Velocity changes of a full step of time_lapse, caused by gravity
+     at the positions x, y instead of those of the balls (with the
+     masses of the balls), for the first rows balls; all balls pull,
+     and so does the far field.
+   */
+  void field(const real *x, const real *y, real *dvx, real *dvy, std::size_t rows)
+  {
+    local_field(x,y,dvx,dvy,rows);
+    if (!far_.empty())
+      pool_->parallel_for(rows,chunk_size / 16,[this,x,y,dvx,dvy](std::size_t b, std::size_t e, unsigned) {
+          for (std::size_t i = b ; i < e ; ++i)
+            {
+              const Vec2d dv = far_pull(i,x[i],y[i]);
+              dvx[i] += dv.x;
+              dvy[i] += dv.y;
+            }
+        });
+  }
+
+  /* The pull of the far field on ball i, if it were at x, y. */
+  Vec2d far_pull(std::size_t i, double x, double y) const
+  {
+    const double mi = balls_.m[i];
+    double ax = 0.0;
+    double ay = 0.0;
+    for (const PseudoBall &body : far_)
+      {
+        const double dx = x - body.com.x;
+        const double dy = y - body.com.y;
+        const double r2 = dx * dx + dy * dy;
+        if (r2 > 0)
+          {
+            const double s = gravity_constant * ((body.count * mi + body.mass) / r2);
+            ax += s * dx;
+            ay += s * dy;
+          }
+      }
+    return { ax, ay };
+  }
+
+  /* The part of field() that comes from the balls. */
+  void local_field(const real *x, const real *y, real *dvx, real *dvy, std::size_t rows)
+  {
+    const std::size_t n = balls_.size();
+    if (gravity_ == Gravity::pairwise)
+      pool_->parallel_for(rows,gravity_rows,[this,n,x,y,dvx,dvy](std::size_t b, std::size_t e, unsigned) {
+          const real *const p[] = { x, y };
+          real *const dv[] = { dvx + b, dvy + b };
+          kernels_->gravity(p,balls_.m.data(),n,b,e,gravity_constant,dv);
+        });
+    else if (gravity_ == Gravity::cutoff)
+      {
+        mesh_.split(cutoff_radius());
+        build_mesh(x,y);
+        near_.build(n,cutoff_radius(),[x,y](std::size_t i) { return Vec2d { x[i], y[i] }; });
+        pool_->parallel_for(rows,chunk_size / 16,[this,x,y,dvx,dvy](std::size_t b, std::size_t e, unsigned) {
+            for (std::size_t i = b ; i < e ; ++i)
+              {
+                const Vec2d dv = mesh_.field(i,gravity_constant) + near_pull(x,y,i);
+                dvx[i] = dv.x;
+                dvy[i] = dv.y;
+              }
+          });
+      }
+    else
+      {
+        if (gravity_ == Gravity::particle_mesh)
+          {
+            mesh_.split(0.0);
+            build_mesh(x,y);
+          }
+        else
+          build_tree(x,y);
+        pool_->parallel_for(rows,chunk_size / 16,[this,dvx,dvy](std::size_t b, std::size_t e, unsigned) {
+            for (std::size_t i = b ; i < e ; ++i)
+              {
+                const Vec2d dv = (gravity_ == Gravity::particle_mesh
+                                  ? mesh_.field(i,gravity_constant)
+                                  : tree_.field(i,gravity_constant));
+                dvx[i] = dv.x;
+                dvy[i] = dv.y;
+              }
+          });
+      }
+  }
+
+  void build_mesh(const real *x, const real *y)
+  {
+    mesh_.build(balls_.size(),
+                [x,y](std::size_t i) { return Vec2d { x[i], y[i] }; },
+                [this](std::size_t i) { return balls_.m[i]; },
+                *pool_);
+  }
+
+  /* The part of the pull on ball i, at x[i], y[i], that the mesh of
+     the cutoff method leaves out, from the balls in the cells of near_
+     around it. */
+  Vec2d near_pull(const real *x, const real *y, std::size_t i) const
+  {
+    const double mi = balls_.m[i];
+    double ax = 0.0;
+    double ay = 0.0;
+    near_.foreach_neighbor(i,[&](std::size_t j) {
+        const double dx = double(x[i]) - x[j];
+        const double dy = double(y[i]) - y[j];
+        const double r2 = dx * dx + dy * dy;
+        const double w  = (r2 > 0 ? mesh_.short_range(r2) : 0.0);
+        if (w > 0)
+          {
+            const double s = gravity_constant * w * ((mi + balls_.m[j]) / r2);
+            ax += s * dx;
+            ay += s * dy;
+          }
+      });
+    return { ax, ay };
+  }
+
+  /* Add the velocity changes dvx, dvy of a full step, scaled to dt. */
+  void kick(const real *dvx, const real *dvy, double dt)
+  {
+    const double scale = dt / time_lapse;
+    pool_->parallel_for(awake_,chunk_size,[this,scale,dvx,dvy](std::size_t b, std::size_t e, unsigned) {
+        for (std::size_t i = b ; i < e ; ++i)
+          {
+            balls_.vx[i] += scale * dvx[i];
+            balls_.vy[i] += scale * dvy[i];
+          }
+      });
+  }
+
+  /**
+     Velocity Verlet: half a kick, the move, the walls and collisions,
+     and another half kick with the gravity at the new positions, which
+     is kept for the first half kick of the next substep. It is only
+     computed again at the start if the balls have been replaced or
+     the gravity method has changed since.
+   */
+  void verlet(double dt)
+  {
+    const std::size_t n = balls_.size();
+    if (!accel_valid_ || ax_.size() != n)
+      {
+        SIMUL_PROFILE_SCOPE(profiler_,Profiler::gravity);
+        ax_.resize(n);
+        ay_.resize(n);
+        field(balls_.x.data(),balls_.y.data(),ax_.data(),ay_.data(),awake_);
+      }
+    kick(ax_.data(),ay_.data(),dt / 2);
+    integrate(dt);
+    walls();
+    collisions();
+    {
+      SIMUL_PROFILE_SCOPE(profiler_,Profiler::gravity);
+      field(balls_.x.data(),balls_.y.data(),ax_.data(),ay_.data(),awake_);
+      kick(ax_.data(),ay_.data(),dt / 2);
+    }
+    accel_valid_ = true;
+  }
+
+  /**
+     Classical Runge–Kutta for x' = v, v' = a(x): the gravity is
+     evaluated at four stages, each from the start of the substep with
+     the velocity and velocity change of the stage before, and the
+     substep moves the balls by the weighted sums of the stages. The
+     stages live in the arena. Sleeping balls stay where they are.
+   */
+  void rk4(double dt)
+  {
+    static const double weight[] = { 1.0, 2.0, 2.0, 1.0 };
+    static const double next[]   = { 0.5, 0.5, 1.0 };
+    SIMUL_PROFILE_SCOPE(profiler_,Profiler::gravity);
+
+    const std::size_t n     = balls_.size();
+    const double      scale = dt / time_lapse;
+    const Arena::Mark mark  = arena_.mark();
+    /* Position and velocity of the stage, the velocity change at it,
+       and the weighted sums of the velocities and velocity changes. */
+    real *const px  = arena_.allocate<real>(n);
+    real *const py  = arena_.allocate<real>(n);
+    real *const vx  = arena_.allocate<real>(n);
+    real *const vy  = arena_.allocate<real>(n);
+    real *const dvx = arena_.allocate<real>(n);
+    real *const dvy = arena_.allocate<real>(n);
+    real *const sx  = arena_.allocate<real>(n);
+    real *const sy  = arena_.allocate<real>(n);
+    real *const svx = arena_.allocate<real>(n);
+    real *const svy = arena_.allocate<real>(n);
+    std::copy(balls_.x.begin() + awake_,balls_.x.end(),px + awake_);
+    std::copy(balls_.y.begin() + awake_,balls_.y.end(),py + awake_);
+
+    for (std::size_t k = 0 ; k < 4 ; ++k)
+      {
+        if (k == 0)
+          field(balls_.x.data(),balls_.y.data(),dvx,dvy,awake_);
+        else
+          field(px,py,dvx,dvy,awake_);
+        pool_->parallel_for(awake_,chunk_size,[&,k](std::size_t b, std::size_t e, unsigned) {
+            for (std::size_t i = b ; i < e ; ++i)
+              {
+                const double ux = (k == 0 ? balls_.vx[i] : vx[i]);
+                const double uy = (k == 0 ? balls_.vy[i] : vy[i]);
+                sx[i]  = (k == 0 ? 0.0 : sx[i]) + weight[k] * ux;
+                sy[i]  = (k == 0 ? 0.0 : sy[i]) + weight[k] * uy;
+                svx[i] = (k == 0 ? 0.0 : svx[i]) + weight[k] * dvx[i];
+                svy[i] = (k == 0 ? 0.0 : svy[i]) + weight[k] * dvy[i];
+                if (k < 3)
+                  {
+                    px[i] = balls_.x[i] + next[k] * dt * ux;
+                    py[i] = balls_.y[i] + next[k] * dt * uy;
+                    vx[i] = balls_.vx[i] + next[k] * scale * dvx[i];
+                    vy[i] = balls_.vy[i] + next[k] * scale * dvy[i];
+                  }
+              }
+          });
+      }
+
+    pool_->parallel_for(awake_,chunk_size,[&](std::size_t b, std::size_t e, unsigned) {
+        for (std::size_t i = b ; i < e ; ++i)
+          {
+            balls_.x[i]  += dt / 6 * sx[i];
+            balls_.y[i]  += dt / 6 * sy[i];
+            balls_.vx[i] += scale / 6 * svx[i];
+            balls_.vy[i] += scale / 6 * svy[i];
+          }
+      });
+    arena_.rewind(mark);
+  }
+
+  /**
+     Broad phase on the uniform grid. The cell width is at least the
+     largest diameter of any ball. The pairs are resolved by tiles of
+     the grid (see foreach_tile()); for each ball i, the neighbors
+     j > i are sorted, so that they come in the same order as in the
+     all-pairs loop.
+   */
+  void grid_collisions()
+  {
+    build_grid(balls_.x.data(),balls_.y.data());
+    foreach_tile(grid_,[this](std::size_t i, unsigned worker) {
+        worker_contacts_[worker] += collide_neighbors(i,scratch_[worker],worker_pairs_[worker],
+                                                      worker_ghost_ends_[worker]);
+      });
+  }
+
+  /**
+     Broad phase on the neighbor list (see neighbor_list.h), which is
+     only built again when a ball has moved far enough. The cooldown
+     of recent collisions is kept with the pairs of the list instead
+     of the balls. The pairs of ball i are resolved in the tile of the
+     cell i was in when the list was built, since they are never
+     further than the next cell of that grid.
+   */
+  void list_collisions()
+  {
+    const std::size_t n = balls_.size();
+    const real *const x = balls_.x.data();
+    const real *const y = balls_.y.data();
+    auto pos = [x,y](std::size_t i) { return Vec2d { x[i], y[i] }; };
+    if (neighbors_.stale(n,awake_,skin_,pos))
+      neighbors_.build(n,awake_,skin_,pos,
+                       [this](std::size_t i) { return balls_.rad[i]; },
+                       [this](std::size_t i) { return balls_.cold[i].id; },
+                       *pool_);
+
+    foreach_tile(neighbors_.grid(),[this](std::size_t i, unsigned worker) {
+        for (NeighborList::Pair *pair = neighbors_.begin(i) ; pair != neighbors_.end(i) ; ++pair)
+          {
+            if (pair->cooldown > 0 && --pair->cooldown > 0)
+              continue;
+            if (resolve(i,pair->j))
+              {
+                pair->cooldown = 3;
+                ++worker_contacts_[worker];
+                worker_ghost_ends_[worker] += ghost_ends(i,pair->j);
+              }
+          }
+        worker_pairs_[worker] += neighbors_.end(i) - neighbors_.begin(i);
+      });
+  }
+
+  /**
+     Call func(i,worker) for each awake ball i, tile by tile.
+
+     The grid is cut into tiles of 2x2 cells, colored like a
+     checkerboard in four colors. The pairs of ball i are resolved by
+     the tile of i, and touch at most the cells next to the tile; two
+     tiles of the same color are two cells apart, so they never touch
+     the same ball and can run in parallel, in any order, with the
+     same result. The four colors run one after the other. With one
+     thread, the tiles run in the same order, so the number of
+     threads doesn't change the result.
+
+     The contacts, ghost ends and pairs func adds up in
+     worker_contacts_, worker_ghost_ends_ and worker_pairs_ are
+     counted at the end.
+   */
+  template <class Func>
+  void foreach_tile(const UniformGrid &grid, Func &&func)
+  {
+    std::fill(begin(worker_contacts_),end(worker_contacts_),0);
+    std::fill(begin(worker_ghost_ends_),end(worker_ghost_ends_),0);
+    std::fill(begin(worker_pairs_),end(worker_pairs_),0);
+    const std::size_t tiles = (grid.dim() + 1) / 2;
+    for (std::size_t color = 0 ; color < 4 ; ++color)
+      {
+        const std::size_t tx0 = color % 2;
+        const std::size_t ty0 = color / 2;
+        const std::size_t nx  = (tiles - tx0 + 1) / 2;
+        const std::size_t ny  = (tiles - ty0 + 1) / 2;
+
+        pool_->parallel_for(nx * ny,4,[&](std::size_t b, std::size_t e, unsigned worker) {
+            for (std::size_t t = b ; t < e ; ++t)
+              {
+                const std::size_t tx = tx0 + 2 * (t % nx);
+                const std::size_t ty = ty0 + 2 * (t / nx);
+                for (std::size_t y = 2 * ty ; y < std::min(2 * ty + 2,grid.dim()) ; ++y)
+                  for (std::size_t x = 2 * tx ; x < std::min(2 * tx + 2,grid.dim()) ; ++x)
+                    grid.foreach_in_cell(x,y,[&](std::size_t i) {
+                        if (i < awake_)
+                          func(i,worker);
+                      });
+              }
+          });
+      }
+    for (std::size_t c : worker_contacts_)
+      contacts_ += c;
+    for (std::size_t g : worker_ghost_ends_)
+      ghost_ends_ += g;
+    SIMUL_PROFILE_ONLY(for (std::size_t p : worker_pairs_)
+                         profiler_.count(Profiler::pairs,p);)
+  }
+
+  /**
+     Resolve the collisions of ball i with its neighbors j > i on the
+     grid, in the order of j. The list of neighbors is made in the
+     given arena, and freed again. Returns the number of contacts, and
+     adds the number of pairs tested to pairs, and the number of
+     ghosts in the contacts to ghosts.
+   */
+  std::size_t collide_neighbors(std::size_t i, Arena &arena, std::size_t &pairs,
+                                std::size_t &ghosts)
+  {
+    const Arena::Mark mark = arena.mark();
+    ArenaVector<std::size_t> neighbors(arena);
+    grid_.foreach_neighbor(i,[&neighbors,i](std::size_t j) {
+        if (j > i)
+          neighbors.push_back(j);
+      });
+    std::sort(neighbors.begin(),neighbors.end());
+
+    std::size_t contacts = 0;
+    for (std::size_t j : neighbors)
+      if (collide(i,j))
+        {
+          ++contacts;
+          ghosts += ghost_ends(i,j);
+        }
+    pairs += neighbors.size();
+    arena.rewind(mark);
+    return contacts;
+  }
+
+  /* How many of balls i and j are ghosts. */
+  std::size_t ghost_ends(std::size_t i, std::size_t j) const
+  {
+    const std::size_t first = balls_.size() - ghosts_;
+    return (i >= first) + (j >= first);
+  }
+
+  /**
+     Narrow phase: check whether balls i and j overlap, and if so,
+     resolve the collision. Returns true if they collided. A collision
+     between two balls that collided less than three substeps ago is
+     ignored, so that they have time to separate.
+   */
+  bool collide(std::size_t i, std::size_t j)
+  {
+    using std::make_pair;
+
+    auto &cold1 = balls_.cold[i];
+    auto &cold2 = balls_.cold[j];
+    if ((cold1.recent_collision.first == cold2.id)
+        || (cold2.recent_collision.first == cold1.id))
+      return false;
+    if (!resolve(i,j))
+      return false;
+
+    /* Only the counters of awake balls run down. */
+    cold1.recent_collision = make_pair(cold2.id,3u);
+    if (j < awake_ || cold2.calm == 0)
+      cold2.recent_collision = make_pair(cold1.id,3u);
+    return true;
+  }
+
+  /**
+     Resolve the collision of balls i and j, if they overlap, and
+     return whether they did.
+
+     Ball i is awake. If ball j is asleep, it wakes up if i comes at
+     it faster than the sleep speed; otherwise i bounces off it as if
+     it had infinite mass, and it stays where it is.
+   */
+  bool resolve(std::size_t i, std::size_t j)
+  {
+    using std::numeric_limits;
+    static const double eps = numeric_limits<double>::epsilon();
+
+    const double rad1 = balls_.rad[i];
+    const double rad2 = balls_.rad[j];
+    Vec2d p1 { balls_.x[i], balls_.y[i] };
+    Vec2d p2 { balls_.x[j], balls_.y[j] };
+
+    auto deltap = p1 - p2;
+    double sqr_dist = sqr(deltap.x) + sqr(deltap.y);
+    double sqr_rad  = sqr(rad1 + rad2);
+
+    if (sqr_dist < sqr_rad)
+      {
+        if (sqr_dist < eps)
+          sqr_dist = eps;
+
+        /* Collision of two balls. */
+        double dist = ::sqrt(sqr_dist);
+        if (dist < eps)
+          dist = eps;
+        Vec2d min_trans_dist = ((rad1 + rad2 - dist) / dist) * deltap;
+
+        const double m1    = balls_.m[i];
+        const double m2    = balls_.m[j];
+        const double sum_m = m1 + m2;
+
+        Vec2d u1 { balls_.vx[i], balls_.vy[i] };
+        Vec2d u2 { balls_.vx[j], balls_.vy[j] };
+        Vec2d v1 = u1;
+        Vec2d v2 = u2;
+
+        if (j >= awake_)
+          {
+            if (-dot(u1,deltap) / dist > sleep_speed_)
+              balls_.cold[j].calm = 0;
+            else
+              {
+                v1 -= 2 * (dot(u1,deltap) / sqr_dist) * deltap;
+                p1 += min_trans_dist;
+                balls_.x[i]  = p1.x;
+                balls_.y[i]  = p1.y;
+                balls_.vx[i] = v1.x;
+                balls_.vy[i] = v1.y;
+                return true;
+              }
+          }
+
+        /* sqr_dist is norm(p1 - p2), but kept away from zero, so
+           that two balls stuck on the same spot (e.g. in a corner)
+           don't turn into NaN. */
+        v1 -=
+          (2*m2 / sum_m)
+          * (dot(u1 - u2,p1 - p2) / sqr_dist)
+          * (p1 - p2);
+
+        v2 -=
+          (2*m1 / sum_m)
+          * (dot(u2 - u1,p2 - p1) / sqr_dist)
+          * (p2 - p1);
+
+        p1 += ((1/m1) / (1/m1+1/m2)) * min_trans_dist;
+        p2 -= ((1/m2) / (1/m1+1/m2)) * min_trans_dist;
+
+        balls_.x[i]  = p1.x;
+        balls_.y[i]  = p1.y;
+        balls_.vx[i] = v1.x;
+        balls_.vy[i] = v1.y;
+        balls_.x[j]  = p2.x;
+        balls_.y[j]  = p2.y;
+        balls_.vx[j] = v2.x;
+        balls_.vy[j] = v2.y;
+        return true;
+      }
+    return false;
+  }
+
+  std::default_random_engine rand_;
+  Particles                  balls_;
+  BroadPhase                 broad_phase_;
+  UniformGrid                grid_;
+  std::size_t                contacts_;
+  Gravity                    gravity_;
+  QuadTree                   tree_;
+  ParticleMesh               mesh_;
+  UniformGrid                near_;
+  double                     cutoff_cells_;
+  unsigned long              steps_;
+  double                     gravity_error_;
+  const Kernels             *kernels_;
+  Arena                      arena_;
+  std::unique_ptr<ThreadPool> pool_;
+  std::vector<Arena>         scratch_;
+  std::vector<std::size_t>   worker_contacts_;
+  std::vector<std::size_t>   worker_ghost_ends_;
+  std::size_t                ghost_ends_;
+  Integrator                 integrator_;
+  EventDrivenEngine          events_;
+  std::vector<std::size_t>   worker_pairs_;
+  Profiler                   profiler_;
+  unsigned                   sort_interval_;
+  Scheme                     scheme_;
+  double                     courant_;
+  unsigned                   substeps_;
+  bool                       accel_valid_;
+  std::vector<real>          ax_;
+  std::vector<real>          ay_;
+  double                     sleep_speed_;
+  unsigned                   sleep_steps_;
+  std::size_t                awake_;
+  NeighborList               neighbors_;
+  double                     skin_;
+  std::size_t                ghosts_;
+  std::vector<PseudoBall>    far_;
+};
+
+#endif // GTKMM_EXAMPLE_SIMULATION_H
@@ -0,0 +1,168 @@
+#ifndef GTKMM_EXAMPLE_SPRITE_CACHE_H
+#define GTKMM_EXAMPLE_SPRITE_CACHE_H
+
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cairomm/context.h>
+#include <cairomm/surface.h>
+
+/**
+   Cache of pre-rendered balls, to be blitted instead of drawing an
+   arc for every ball in every frame.
+
+   A sprite is a filled, anti-aliased ellipse with the given radii in
+   pixels, in one color, on a transparent square. Sprites are looked
+   up by a key chosen by the caller (see Renderer), which must
+   identify the radii and the color.
+
+   The sprites depend on the size of the target in pixels, so
+   target() drops them all when that changes. The memory used by the
+   surfaces is bounded by max_bytes(); when a new sprite would exceed
+   it, the least recently used sprites are dropped first.
+ */
+class SpriteCache
+{
+public:
+  enum : std::size_t { default_max_bytes = 32u << 20 };
+
+  struct Sprite
+  {
+    Cairo::RefPtr<Cairo::ImageSurface> surface;
+    /* Size of the surface; the center of the ellipse is at its
+       middle. */
+    int width;
+    int height;
+  };
+
+  explicit SpriteCache(std::size_t max_bytes = default_max_bytes)
+    : max_bytes_(max_bytes),
+      bytes_(0),
+      target_width_(0),
+      target_height_(0),
+      lru_(),
+      index_(),
+      hits_(0),
+      misses_(0)
+  { }
+
+  void max_bytes(std::size_t bytes)
+  {
+    max_bytes_ = bytes;
+    evict(0);
+  }
+
+  std::size_t max_bytes() const
+  { return max_bytes_; }
+
+  /**
+     Bytes used by the surfaces of the cached sprites.
+   */
+  std::size_t bytes() const
+  { return bytes_; }
+
+  std::size_t size() const
+  { return index_.size(); }
+
+  unsigned long hits() const
+  { return hits_; }
+
+  unsigned long misses() const
+  { return misses_; }
+
+  void clear()
+  {
+    lru_.clear();
+    index_.clear();
+    bytes_ = 0;
+  }
+
+  /**
+     Set the size in pixels of the target the sprites are drawn to.
+     If it has changed, all sprites are dropped.
+   */
+  void target(int width, int height)
+  {
+    if (width != target_width_ || height != target_height_)
+      clear();
+    target_width_  = width;
+    target_height_ = height;
+  }
+
+  /**
+     The sprite of the given key, rendered now if it isn't cached.
+   */
+  const Sprite &get(std::uint64_t key,
+                    double        rx,
+                    double        ry,
+                    double        red,
+                    double        green,
+                    double        blue)
+  {
+    const auto found = index_.find(key);
+    if (found != index_.end())
+      {
+        ++hits_;
+        lru_.splice(lru_.begin(),lru_,found->second);
+        return found->second->second;
+      }
+
+    ++misses_;
+    Sprite sprite = render(rx,ry,red,green,blue);
+    const std::size_t bytes = size_of(sprite);
+    evict(bytes);
+    lru_.emplace_front(key,sprite);
+    index_[key] = lru_.begin();
+    bytes_ += bytes;
+    return lru_.front().second;
+  }
+
+private:
+  using Entry = std::pair<std::uint64_t,Sprite>;
+
+  static std::size_t size_of(const Sprite &sprite)
+  { return std::size_t(sprite.surface->get_stride()) * sprite.height; }
+
+  static Sprite render(double rx, double ry, double red, double green, double blue)
+  {
+    Sprite sprite;
+    sprite.width   = 2 * static_cast<int>(std::ceil(rx)) + 2;
+    sprite.height  = 2 * static_cast<int>(std::ceil(ry)) + 2;
+    sprite.surface = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32,
+                                                 sprite.width,sprite.height);
+
+    auto cr = Cairo::Context::create(sprite.surface);
+    cr->translate(sprite.width / 2.0,sprite.height / 2.0);
+    cr->scale(rx,ry);
+    cr->arc(0.0,0.0,1.0,0,2*M_PI);
+    cr->set_source_rgb(red,green,blue);
+    cr->fill();
+    sprite.surface->flush();
+    return sprite;
+  }
+
+  /* Drop the least recently used sprites until another bytes fit. */
+  void evict(std::size_t bytes)
+  {
+    while (!lru_.empty() && bytes_ + bytes > max_bytes_)
+      {
+        bytes_ -= size_of(lru_.back().second);
+        index_.erase(lru_.back().first);
+        lru_.pop_back();
+      }
+  }
+
+  std::size_t                                                  max_bytes_;
+  std::size_t                                                  bytes_;
+  int                                                          target_width_;
+  int                                                          target_height_;
+  std::list<Entry>                                             lru_;
+  std::unordered_map<std::uint64_t,std::list<Entry>::iterator> index_;
+  unsigned long                                                hits_;
+  unsigned long                                                misses_;
+};
+
+#endif // GTKMM_EXAMPLE_SPRITE_CACHE_H
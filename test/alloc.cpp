@@ -0,0 +1,103 @@
+/*
+  Once it has warmed up, a step of the time-stepping integrator
+  doesn't allocate memory, and neither does saving a checkpoint every
+  few steps and writing it in the background.
+
+  As in the headless program built with -DSIMUL_CHECK_ALLOC, the
+  global operator new counts its calls, on all threads (see
+  check_alloc.h).
+*/
+
+#include <string>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <cstdio>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "../simulation.h"
+#include "../checkpoint.h"
+#include "../check_alloc.h"
+
+namespace {
+
+using BroadPhase = Simulation::BroadPhase;
+using Gravity    = Simulation::Gravity;
+using Scheme     = Simulation::Scheme;
+
+const unsigned steps = 100;
+const unsigned every = 10;
+
+void run(Simulation &sim, CheckpointWriter &writer, const std::string &path)
+{
+  for (unsigned s = 0 ; s < steps ; ++s)
+    {
+      sim.step();
+      if (!path.empty() && (s + 1) % every == 0)
+        {
+          sim.save(writer.back());
+          writer.save(path);
+        }
+    }
+  writer.wait();
+}
+
+/* The allocations of steps steps, with a checkpoint saved every
+   every steps if path isn't empty. The same steps are run once
+   before, from the same state, so that all buffers have grown to
+   what these steps need: with gravity, the balls gather into
+   clusters for a few hundred steps, and the work of a step grows
+   with them. */
+unsigned long allocations_of(Simulation &sim, const std::string &path = std::string())
+{
+  CheckpointWriter writer;
+  Checkpoint start;
+  sim.save(start);
+  run(sim,writer,path);
+  sim.restore(std::move(start));
+
+  const unsigned long before = check_alloc::allocations.load();
+  run(sim,writer,path);
+  const unsigned long during = check_alloc::allocations.load() - before;
+  EXPECT_EQ(writer.failures(),0u);
+  return during;
+}
+
+} // namespace
+
+TEST(Alloc,StepsDontAllocate)
+{
+  for (BroadPhase method : { BroadPhase::uniform_grid, BroadPhase::neighbor_list })
+    for (Gravity gravity : { Gravity::none, Gravity::pairwise,
+                             Gravity::barnes_hut, Gravity::particle_mesh,
+                             Gravity::cutoff })
+      {
+        Simulation sim(3,500,method,gravity);
+        sim.mesh_size(32);
+        sim.threads(2);
+        EXPECT_EQ(allocations_of(sim),0u)
+          << "broad phase " << int(method) << ", gravity " << int(gravity);
+      }
+
+  Simulation sim(3,500);
+  sim.scheme(Scheme::verlet);
+  sim.adaptive(0.5);
+  EXPECT_EQ(allocations_of(sim),0u) << "verlet, adaptive";
+}
+
+TEST(Alloc,CheckpointsDontAllocate)
+{
+  const std::string path = testing::TempDir() + "simul-test-" + std::to_string(::getpid())
+    + "-a-path-longer-than-a-short-string.ckp";
+  Simulation sim(3,500);
+  sim.threads(2);
+  EXPECT_EQ(allocations_of(sim,path),0u);
+
+  Checkpoint state;
+  EXPECT_TRUE(read_checkpoint(path,state));
+  EXPECT_EQ(state.steps,steps);
+  std::remove(path.c_str());
+}
@@ -0,0 +1,109 @@
+/*
+  The Barnes–Hut quadtree against the exact pairwise gravity: with an
+  opening angle of 0 it is exact up to rounding, and at the default
+  angle its error stays small, also for balls in clusters. The cutoff
+  method, which sums the near pairs exactly, is closer to it than the
+  mesh alone.
+*/
+
+#include <vector>
+#include <random>
+#include <cmath>
+#include <limits>
+
+#include <gtest/gtest.h>
+
+#include "../simulation.h"
+#include "../barnes_hut.h"
+
+namespace {
+
+using Gravity = Simulation::Gravity;
+
+const double G = Simulation::gravity_constant;
+
+struct Body
+{
+  Vec2d  p;
+  double m;
+};
+
+std::vector<Body> bodies(unsigned seed, std::size_t n, bool clustered)
+{
+  std::default_random_engine rand(seed);
+  std::uniform_real_distribution<double> pos_dist(0.0,1.0);
+  std::normal_distribution<double>       offset_dist(0.0,0.02);
+  std::uniform_real_distribution<double> mass_dist(0.01,0.2);
+  std::vector<Body> result;
+  for (std::size_t i = 0 ; i < n ; ++i)
+    {
+      Vec2d p { pos_dist(rand), pos_dist(rand) };
+      if (clustered)
+        p = Vec2d { 0.3 + 0.4 * (i % 2), 0.5 } + Vec2d { offset_dist(rand), offset_dist(rand) };
+      result.push_back({ p, mass_dist(rand) });
+    }
+  return result;
+}
+
+Vec2d exact(const std::vector<Body> &b, std::size_t i)
+{
+  Vec2d result {};
+  for (std::size_t j = 0 ; j < b.size() ; ++j)
+    {
+      const Vec2d  d  = b[i].p - b[j].p;
+      const double r2 = norm(d);
+      if (r2 > 0)
+        result += (G * (b[i].m + b[j].m) / r2) * d;
+    }
+  return result;
+}
+
+/* Relative RMS error of the tree against the exact sum. */
+double error(const std::vector<Body> &b, double theta)
+{
+  QuadTree tree(theta);
+  tree.build(b.size(),
+             [&b](std::size_t i) { return b[i].p; },
+             [&b](std::size_t i) { return b[i].m; });
+  double sqr_err = 0.0;
+  double sqr_ref = 0.0;
+  for (std::size_t i = 0 ; i < b.size() ; ++i)
+    {
+      const Vec2d ref = exact(b,i);
+      sqr_err += norm(tree.field(i,G) - ref);
+      sqr_ref += norm(ref);
+    }
+  return ::sqrt(sqr_err / sqr_ref);
+}
+
+} // namespace
+
+TEST(BarnesHut,ExactWithoutOpening)
+{
+  for (bool clustered : { false, true })
+    EXPECT_LT(error(bodies(23,500,clustered),0.0),1e-12);
+}
+
+TEST(BarnesHut,CloseToExact)
+{
+  for (bool clustered : { false, true })
+    EXPECT_LT(error(bodies(23,2000,clustered),0.5),0.01);
+}
+
+TEST(BarnesHut,MeasuredErrorOfSimulation)
+{
+  Simulation sim(23,1000,Simulation::BroadPhase::uniform_grid,Gravity::barnes_hut,0.5);
+  EXPECT_LT(sim.gravity_error(),0.01);
+  sim.theta(0.0);
+  EXPECT_LT(sim.gravity_error(),64 * std::numeric_limits<real>::epsilon());
+}
+
+TEST(BarnesHut,CutoffCloserThanMesh)
+{
+  Simulation sim(23,1000,Simulation::BroadPhase::uniform_grid,Gravity::particle_mesh);
+  const double mesh = sim.gravity_error();
+  sim.gravity(Gravity::cutoff);
+  const double cutoff = sim.gravity_error();
+  EXPECT_LT(cutoff,0.01);
+  EXPECT_LT(cutoff,mesh / 2);
+}
@@ -0,0 +1,94 @@
+/*
+  The uniform grid and the neighbor list find the same contacts as the
+  all-pairs loop.
+
+  The balls come in pairs that overlap a little, far enough from all
+  other balls that no ball touches more than one other, so that the
+  order in which a broad phase visits the pairs doesn't matter. The
+  pairs lie at random, across the cells of the grid, and the balls
+  come in random order.
+*/
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <gtest/gtest.h>
+
+#include "../simulation.h"
+
+namespace {
+
+using BroadPhase = Simulation::BroadPhase;
+using Gravity    = Simulation::Gravity;
+
+Particles touching_pairs(unsigned seed, std::size_t pairs)
+{
+  std::default_random_engine rand(seed);
+  std::uniform_real_distribution<double> pos_dist(0.05,0.95);
+  std::uniform_real_distribution<double> angle_dist(0.0,2 * M_PI);
+  std::uniform_real_distribution<double> speed_dist(-0.00003,0.00003);
+
+  std::vector<Vec2d> centers;
+  while (centers.size() < pairs)
+    {
+      const Vec2d c { pos_dist(rand), pos_dist(rand) };
+      if (std::all_of(centers.begin(),centers.end(),[&c](const Vec2d &o) {
+            return len(c - o) > 0.05;
+          }))
+        centers.push_back(c);
+    }
+
+  /* Balls of mass 0.05 have a radius of 0.006. */
+  std::vector<Ball> balls;
+  for (const Vec2d &c : centers)
+    {
+      const double a = angle_dist(rand);
+      const Vec2d  d { 0.005 * ::cos(a), 0.005 * ::sin(a) };
+      balls.push_back(Ball(c + d,{ speed_dist(rand), speed_dist(rand) },0.05));
+      balls.push_back(Ball(c - d,{ speed_dist(rand), speed_dist(rand) },0.05));
+    }
+  std::shuffle(balls.begin(),balls.end(),rand);
+
+  Particles result;
+  for (const Ball &ball : balls)
+    result.push_back(ball);
+  return result;
+}
+
+bool same(const std::vector<real> &a, const std::vector<real> &b)
+{
+  return (a.size() == b.size()
+          && std::memcmp(a.data(),b.data(),a.size() * sizeof(real)) == 0);
+}
+
+} // namespace
+
+TEST(BroadPhase,SameContactsAsAllPairs)
+{
+  const std::size_t pairs = 200;
+  for (unsigned seed : { 1u, 2u, 3u })
+    {
+      Simulation reference(seed,0,BroadPhase::all_pairs,Gravity::none);
+      reference.balls(touching_pairs(seed,pairs));
+      reference.collisions();
+      EXPECT_EQ(reference.contacts(),pairs);
+
+      for (BroadPhase method : { BroadPhase::uniform_grid, BroadPhase::neighbor_list })
+        {
+          Simulation sim(seed,0,method,Gravity::none);
+          sim.balls(touching_pairs(seed,pairs));
+          sim.collisions();
+          EXPECT_EQ(sim.contacts(),reference.contacts());
+
+          const Particles &a = sim.balls();
+          const Particles &b = reference.balls();
+          EXPECT_TRUE(same(a.x,b.x));
+          EXPECT_TRUE(same(a.y,b.y));
+          EXPECT_TRUE(same(a.vx,b.vx));
+          EXPECT_TRUE(same(a.vy,b.vy));
+        }
+    }
+}
@@ -0,0 +1,125 @@
+/*
+  A run that is saved to a checkpoint and continued from it ends in
+  the same state, bit for bit, as one that was never interrupted, in
+  the modes for which Simulation::save() promises it, and a
+  checkpoint comes back from its file as it was written.
+*/
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "../simulation.h"
+#include "../checkpoint.h"
+
+namespace {
+
+using BroadPhase = Simulation::BroadPhase;
+using Gravity    = Simulation::Gravity;
+using Scheme     = Simulation::Scheme;
+
+bool same(const std::vector<real> &a, const std::vector<real> &b)
+{
+  return (a.size() == b.size()
+          && std::memcmp(a.data(),b.data(),a.size() * sizeof(real)) == 0);
+}
+
+void expect_same(const Particles &a, const Particles &b)
+{
+  EXPECT_TRUE(same(a.x,b.x));
+  EXPECT_TRUE(same(a.y,b.y));
+  EXPECT_TRUE(same(a.vx,b.vx));
+  EXPECT_TRUE(same(a.vy,b.vy));
+  EXPECT_TRUE(same(a.m,b.m));
+  EXPECT_TRUE(same(a.rad,b.rad));
+  ASSERT_EQ(a.cold.size(),b.cold.size());
+  for (std::size_t i = 0 ; i < a.cold.size() ; ++i)
+    {
+      EXPECT_EQ(a.cold[i].id,b.cold[i].id);
+      EXPECT_EQ(a.cold[i].recent_collision,b.cold[i].recent_collision);
+      EXPECT_EQ(a.cold[i].calm,b.cold[i].calm);
+    }
+}
+
+/* Run 2 * steps steps in one go, and steps steps, a save and a
+   restore into a new simulation, and steps steps more. */
+void expect_same_run(const std::function<void(Simulation &)> &setup, unsigned steps)
+{
+  Simulation whole(11,500);
+  setup(whole);
+  for (unsigned s = 0 ; s < 2 * steps ; ++s)
+    whole.step();
+
+  Simulation first(11,500);
+  setup(first);
+  for (unsigned s = 0 ; s < steps ; ++s)
+    first.step();
+  Checkpoint state;
+  first.save(state);
+
+  Simulation second(5,0);
+  setup(second);
+  second.restore(std::move(state));
+  for (unsigned s = 0 ; s < steps ; ++s)
+    second.step();
+
+  EXPECT_EQ(second.steps(),whole.steps());
+  EXPECT_EQ(second.contacts(),whole.contacts());
+  expect_same(second.balls(),whole.balls());
+}
+
+} // namespace
+
+TEST(Checkpoint,RestoredRunIsTheSame)
+{
+  for (BroadPhase method : { BroadPhase::all_pairs, BroadPhase::uniform_grid })
+    for (Gravity gravity : { Gravity::none, Gravity::pairwise,
+                             Gravity::barnes_hut, Gravity::particle_mesh,
+                             Gravity::cutoff })
+      for (Scheme scheme : { Scheme::euler, Scheme::verlet })
+        expect_same_run([=](Simulation &sim) {
+            sim.broad_phase(method);
+            sim.gravity(gravity);
+            sim.mesh_size(32);
+            sim.scheme(scheme);
+          },30);
+}
+
+TEST(Checkpoint,RestoredRunIsTheSameWithSleepAndSubsteps)
+{
+  expect_same_run([](Simulation &sim) {
+      sim.sleep(5e-5,3);
+    },30);
+  expect_same_run([](Simulation &sim) {
+      sim.scheme(Scheme::rk4);
+      sim.adaptive(0.5);
+    },30);
+}
+
+TEST(Checkpoint,FileRoundTrip)
+{
+  Simulation sim(3,500);
+  for (unsigned s = 0 ; s < 20 ; ++s)
+    sim.step();
+  Checkpoint saved;
+  sim.save(saved);
+
+  const std::string path = testing::TempDir() + "simul-test-" + std::to_string(::getpid()) + ".ckp";
+  ASSERT_TRUE(write_checkpoint(path,saved));
+  Checkpoint read;
+  ASSERT_TRUE(read_checkpoint(path,read));
+  EXPECT_EQ(read.steps,saved.steps);
+  EXPECT_EQ(read.rng,saved.rng);
+  expect_same(read.balls,saved.balls);
+
+  /* A file cut short is rejected. */
+  ASSERT_EQ(::truncate(path.c_str(),1000),0);
+  EXPECT_FALSE(read_checkpoint(path,read));
+  std::remove(path.c_str());
+}
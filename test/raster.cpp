@@ -0,0 +1,66 @@
+/*
+  The software rasterizer fills each ball with its color, leaves the
+  pixels outside of all balls transparent, and draws the same image on
+  any number of threads, for images that aren't a whole number of
+  tiles wide too.
+*/
+
+#include <vector>
+#include <cstdint>
+
+#include <gtest/gtest.h>
+
+#include "../simulation.h"
+#include "../raster.h"
+
+namespace {
+
+std::uint32_t pixel(Rasterizer &raster, int x, int y)
+{ return raster.pixels()[std::size_t(y) * raster.width() + x]; }
+
+} // namespace
+
+TEST(Raster, FillsBalls)
+{
+  Particles balls;
+  Ball red({ 0.25, 0.25 },{ 0.0, 0.0 },0.1,1.0,0.0,0.0);
+  red.rad = 0.1;
+  Ball blue({ 0.75, 0.5 },{ 0.0, 0.0 },0.1,0.0,0.0,1.0);
+  blue.rad = 0.05;
+  balls.push_back(red);
+  balls.push_back(blue);
+
+  Rasterizer raster;
+  raster.render(balls,200,100);
+  ASSERT_EQ(200,raster.width());
+  ASSERT_EQ(100,raster.height());
+
+  EXPECT_EQ(0xffff0000u,pixel(raster,50,25));
+  EXPECT_EQ(0xff0000ffu,pixel(raster,150,50));
+  EXPECT_EQ(0u,pixel(raster,100,90));
+  EXPECT_EQ(0u,pixel(raster,199,0));
+}
+
+TEST(Raster, SameOnAnyNumberOfThreads)
+{
+  Simulation sim(23,0);
+  Particles balls;
+  for (int i = 0 ; i < 2000 ; ++i)
+    {
+      Ball ball = sim.random_ball();
+      ball.rad = std::min(ball.rad,0.01);
+      balls.push_back(ball);
+    }
+
+  Rasterizer one;
+  one.render(balls,300,170);
+  const std::vector<std::uint32_t> expected(one.pixels(),one.pixels() + 300 * 170);
+  for (unsigned threads : { 2u, 3u, 4u })
+    {
+      Rasterizer raster;
+      raster.threads(threads);
+      raster.render(balls,300,170);
+      EXPECT_EQ(expected,std::vector<std::uint32_t>(raster.pixels(),raster.pixels() + 300 * 170))
+        << threads << " threads";
+    }
+}
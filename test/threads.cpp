@@ -0,0 +1,59 @@
+/*
+  The result of a run doesn't depend on the number of threads: the
+  balls after a hundred steps are the same, bit for bit, with one
+  thread and with several, for each broad phase that runs in parallel
+  and each method of gravity.
+*/
+
+#include <vector>
+#include <cstring>
+
+#include <gtest/gtest.h>
+
+#include "../simulation.h"
+
+namespace {
+
+using BroadPhase = Simulation::BroadPhase;
+using Gravity    = Simulation::Gravity;
+
+bool same(const std::vector<real> &a, const std::vector<real> &b)
+{
+  return (a.size() == b.size()
+          && std::memcmp(a.data(),b.data(),a.size() * sizeof(real)) == 0);
+}
+
+} // namespace
+
+TEST(Threads,SameResultWithAnyNumberOfThreads)
+{
+  const std::size_t n     = 500;
+  const unsigned    steps = 100;
+  for (BroadPhase method : { BroadPhase::uniform_grid, BroadPhase::neighbor_list })
+    for (Gravity gravity : { Gravity::none, Gravity::pairwise,
+                             Gravity::barnes_hut, Gravity::particle_mesh,
+                             Gravity::cutoff })
+      {
+        Simulation reference(7,n,method,gravity);
+        reference.mesh_size(32);
+        for (unsigned s = 0 ; s < steps ; ++s)
+          reference.step();
+
+        for (unsigned threads : { 2u, 3u, 4u })
+          {
+            Simulation sim(7,n,method,gravity);
+            sim.mesh_size(32);
+            sim.threads(threads);
+            for (unsigned s = 0 ; s < steps ; ++s)
+              sim.step();
+
+            EXPECT_EQ(sim.contacts(),reference.contacts());
+            const Particles &a = sim.balls();
+            const Particles &b = reference.balls();
+            EXPECT_TRUE(same(a.x,b.x));
+            EXPECT_TRUE(same(a.y,b.y));
+            EXPECT_TRUE(same(a.vx,b.vx));
+            EXPECT_TRUE(same(a.vy,b.vy));
+          }
+      }
+}
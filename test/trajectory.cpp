@@ -0,0 +1,195 @@
+/*
+  A recorded trajectory reads back as it was recorded: every frame
+  holds the quantized positions of the balls, in the order of their
+  ids, whatever order they had in the simulation. A file that was cut
+  short, or whose index is damaged, gives back the frames it still
+  holds, and fails on the others without reading past its end. A
+  frame with a ball whose id is out of range isn't recorded.
+*/
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "../simulation.h"
+#include "../trajectory.h"
+
+namespace {
+
+const unsigned bits     = 16;
+const unsigned keyframe = 16;
+const unsigned frames   = 40;
+
+/* The position of each ball at each step, in the order of the ids,
+   as the reader should give it back. */
+using Frames = std::vector<std::vector<Vec2d>>;
+
+std::string temp_path(const char *name)
+{ return testing::TempDir() + "simul-test-" + std::to_string(::getpid()) + "-" + name; }
+
+/* As the reader gives it back, in the precision of the balls (see
+   policy.h). */
+double quantized(double v)
+{
+  const double scale = double((1u << bits) - 1);
+  return real(std::lround(std::min(std::max(v,0.0),1.0) * scale) * (1.0 / scale));
+}
+
+Frames record(const std::string &path)
+{
+  Simulation sim(5,300);
+  sim.sort_interval(8);
+  Frames expected;
+  TrajectoryWriter writer(path,sim.balls(),bits,keyframe);
+  for (unsigned f = 0 ; f < frames ; ++f)
+    {
+      sim.step();
+      const Particles &balls = sim.balls();
+      std::vector<Vec2d> frame(balls.size());
+      for (std::size_t i = 0 ; i < balls.size() ; ++i)
+        frame[balls.cold[i].id] = { quantized(balls.x[i]), quantized(balls.y[i]) };
+      expected.push_back(frame);
+      writer.record(balls,sim.steps());
+    }
+  EXPECT_TRUE(writer.close());
+  return expected;
+}
+
+bool same_frame(TrajectoryReader &reader, std::size_t f, const std::vector<Vec2d> &expected)
+{
+  Particles balls;
+  unsigned long step = 0;
+  if (!reader.read(f,balls,&step) || step != f + 1 || balls.size() != expected.size())
+    return false;
+  for (std::size_t i = 0 ; i < balls.size() ; ++i)
+    if (balls.x[i] != expected[i].x || balls.y[i] != expected[i].y)
+      return false;
+  return true;
+}
+
+} // namespace
+
+TEST(Trajectory,RoundTrip)
+{
+  const std::string path = temp_path("round-trip.trj");
+  const Frames expected = record(path);
+
+  TrajectoryReader reader;
+  ASSERT_TRUE(reader.open(path));
+  EXPECT_EQ(reader.balls(),expected[0].size());
+  ASSERT_EQ(reader.frames(),frames);
+
+  /* In order, backwards, and jumping between chunks. */
+  for (unsigned f = 0 ; f < frames ; ++f)
+    EXPECT_TRUE(same_frame(reader,f,expected[f])) << "frame " << f;
+  for (unsigned f = frames ; f > 0 ; --f)
+    EXPECT_TRUE(same_frame(reader,f - 1,expected[f - 1])) << "frame " << f - 1;
+  for (unsigned f : { 37u, 3u, 20u, 19u, 0u })
+    EXPECT_TRUE(same_frame(reader,f,expected[f])) << "frame " << f;
+  Particles balls;
+  EXPECT_FALSE(reader.read(frames,balls));
+  std::remove(path.c_str());
+}
+
+TEST(Trajectory,TruncatedFile)
+{
+  using namespace trajectory_format;
+
+  const std::string path = temp_path("truncated.trj");
+  const Frames expected = record(path);
+
+  /* Cut the file in the middle of the third chunk, which takes the
+     index with it: the first two chunks are found by their headers. */
+  std::FILE *file = std::fopen(path.c_str(),"rb");
+  ASSERT_TRUE(file);
+  std::fseek(file,-long(sizeof(Trailer)),SEEK_END);
+  Trailer t;
+  ASSERT_EQ(std::fread(&t,sizeof(t),1,file),1u);
+  std::vector<ChunkEntry> index(t.chunks);
+  std::fseek(file,long(t.index_offset),SEEK_SET);
+  ASSERT_EQ(std::fread(index.data(),sizeof(ChunkEntry),index.size(),file),index.size());
+  std::fclose(file);
+  ASSERT_EQ(index.size(),3u);
+  ASSERT_EQ(::truncate(path.c_str(),off_t(index[2].offset + sizeof(ChunkHeader) + 10)),0);
+
+  TrajectoryReader reader;
+  ASSERT_TRUE(reader.open(path));
+  ASSERT_EQ(reader.frames(),2 * keyframe);
+  for (unsigned f = 0 ; f < 2 * keyframe ; ++f)
+    EXPECT_TRUE(same_frame(reader,f,expected[f])) << "frame " << f;
+  Particles balls;
+  EXPECT_FALSE(reader.read(2 * keyframe,balls));
+  std::remove(path.c_str());
+}
+
+TEST(Trajectory,DamagedIndex)
+{
+  using namespace trajectory_format;
+
+  const std::string path = temp_path("damaged.trj");
+  const Frames expected = record(path);
+
+  /* Point the second chunk of the index far past the end of the file,
+     and the third one just short of it. */
+  std::FILE *file = std::fopen(path.c_str(),"r+b");
+  ASSERT_TRUE(file);
+  std::fseek(file,0,SEEK_END);
+  const std::uint64_t size = std::ftell(file);
+  std::fseek(file,-long(sizeof(Trailer)),SEEK_END);
+  Trailer t;
+  ASSERT_EQ(std::fread(&t,sizeof(t),1,file),1u);
+  ASSERT_EQ(t.chunks,3u);
+  const std::uint64_t offsets[] = { size + (std::uint64_t(1) << 40), size - 4 };
+  for (std::size_t c = 1 ; c < 3 ; ++c)
+    {
+      std::fseek(file,long(t.index_offset + c * sizeof(ChunkEntry) + sizeof(std::uint64_t)),SEEK_SET);
+      ASSERT_EQ(std::fwrite(&offsets[c - 1],sizeof(std::uint64_t),1,file),1u);
+    }
+  std::fclose(file);
+
+  TrajectoryReader reader;
+  ASSERT_TRUE(reader.open(path));
+  ASSERT_EQ(reader.frames(),frames);
+  for (unsigned f = 0 ; f < keyframe ; ++f)
+    EXPECT_TRUE(same_frame(reader,f,expected[f])) << "frame " << f;
+  Particles balls;
+  EXPECT_FALSE(reader.read(keyframe,balls));
+  EXPECT_FALSE(reader.read(2 * keyframe,balls));
+  std::remove(path.c_str());
+}
+
+TEST(Trajectory,OutOfRangeId)
+{
+  const std::string path = temp_path("out-of-range.trj");
+  Simulation sim(5,300);
+  Particles balls = sim.balls();
+  std::vector<Vec2d> expected(balls.size());
+  for (std::size_t i = 0 ; i < balls.size() ; ++i)
+    expected[balls.cold[i].id] = { quantized(balls.x[i]), quantized(balls.y[i]) };
+
+  {
+    TrajectoryWriter writer(path,balls,bits,keyframe);
+    EXPECT_TRUE(writer.record(balls,1));
+    Particles bad = balls;
+    bad.cold[3].id = balls.size();
+    bad.x[0] = 0.5;
+    EXPECT_FALSE(writer.record(bad,2));
+    EXPECT_TRUE(writer.record(balls,2));
+    EXPECT_EQ(writer.rejected(),1u);
+    EXPECT_TRUE(writer.close());
+  }
+
+  TrajectoryReader reader;
+  ASSERT_TRUE(reader.open(path));
+  ASSERT_EQ(reader.frames(),2u);
+  for (unsigned f = 0 ; f < 2 ; ++f)
+    EXPECT_TRUE(same_frame(reader,f,expected)) << "frame " << f;
+  std::remove(path.c_str());
+}
@@ -100,6 +100,19 @@ public:
     cr->restore();
   }
 
+  /**
+     The area the text box is shown in by show(), with a margin, e.g.
+     to invalidate it when the text changes.
+   */
+  Cairo::RectangleInt area(const int total_width,
+                           const int total_height)
+    const
+  {
+    const int x = static_cast<int>(total_width - box_width_*1.1);
+    const int y = static_cast<int>(total_height - box_height_*1.1);
+    return { x - 2, y - 2, total_width - x + 4, total_height - y + 4 };
+  }
+
 private:
   Gtk::DrawingArea &parent_;
   double            box_width_;
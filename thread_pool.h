@@ -0,0 +1,221 @@
+#ifndef GTKMM_EXAMPLE_THREAD_POOL_H
+#define GTKMM_EXAMPLE_THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+/**
+   A small work-stealing thread pool for the data-parallel loops of
+   the physics step.
+
+   Use as follows:
+
+   ThreadPool pool(4);
+   pool.parallel_for(n,grain,[&](std::size_t begin, std::size_t end,
+                                 unsigned worker) { ... });
+
+   The range [0,n) is cut into chunks of grain elements. The chunks
+   are dealt round-robin to one queue per worker; a worker that runs
+   out of chunks steals from the front of the other queues. The
+   calling thread takes part as worker 0, and parallel_for() returns
+   once all chunks are done.
+
+   The chunks only depend on n and grain, not on the number of
+   threads, so a loop whose chunks write to disjoint data gives the
+   same result with any number of threads. The worker index passed to
+   the function is in [0,size()) and may be used to pick per-thread
+   scratch space, but the result must not depend on it.
+
+   parallel_for() must not be called from inside a chunk, and only
+   from one thread at a time.
+ */
+class ThreadPool
+{
+public:
+  explicit ThreadPool(unsigned threads = 1)
+    : size_(threads > 0 ? threads : 1),
+      queues_(new Queue[size_]),
+      workers_(),
+      mutex_(),
+      wakeup_(),
+      generation_(0),
+      stop_(false),
+      pending_(0)
+  {
+    for (unsigned w = 1 ; w < size_ ; ++w)
+      workers_.emplace_back(&ThreadPool::worker_loop,this,w);
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wakeup_.notify_all();
+    for (auto &worker : workers_)
+      worker.join();
+  }
+
+  /**
+     Number of threads, including the calling thread.
+   */
+  unsigned size() const
+  { return size_; }
+
+  template <class Func>
+  void parallel_for(std::size_t n, std::size_t grain, Func &&func)
+  {
+    if (n == 0)
+      return;
+    if (grain == 0)
+      grain = 1;
+
+    if (size_ == 1 || n <= grain)
+      {
+        for (std::size_t begin = 0 ; begin < n ; begin += grain)
+          func(begin,std::min(begin + grain,n),0u);
+        return;
+      }
+
+    JobImpl<Func> job(func);
+    const std::size_t chunks = (n + grain - 1) / grain;
+    pending_.store(chunks,std::memory_order_relaxed);
+    for (std::size_t c = 0 ; c < chunks ; ++c)
+      {
+        Queue &queue = queues_[c % size_];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back({ &job, c * grain, std::min((c + 1) * grain,n) });
+      }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++generation_;
+    }
+    wakeup_.notify_all();
+
+    work(0);
+    while (pending_.load(std::memory_order_acquire) > 0)
+      std::this_thread::yield();
+  }
+
+private:
+  struct Job
+  {
+    virtual void run(std::size_t begin, std::size_t end, unsigned worker) = 0;
+  protected:
+    ~Job() { }
+  };
+
+  template <class Func>
+  struct JobImpl final : Job
+  {
+    Func &func;
+
+    explicit JobImpl(Func &f)
+      : func(f)
+    { }
+
+    void run(std::size_t begin, std::size_t end, unsigned worker) override
+    { func(begin,end,worker); }
+  };
+
+  struct Task
+  {
+    Job        *job;
+    std::size_t begin;
+    std::size_t end;
+  };
+
+  /* The owner takes tasks from the back, thieves from the front. The
+     vector is only cleared when it runs empty, so its capacity is
+     reused from one loop to the next. */
+  struct Queue
+  {
+    std::mutex        mutex;
+    std::vector<Task> tasks;
+    std::size_t       head = 0;
+
+    bool pop_back(Task &task)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (head == tasks.size())
+        return false;
+      task = tasks.back();
+      tasks.pop_back();
+      if (head == tasks.size())
+        {
+          tasks.clear();
+          head = 0;
+        }
+      return true;
+    }
+
+    bool pop_front(Task &task)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (head == tasks.size())
+        return false;
+      task = tasks[head++];
+      if (head == tasks.size())
+        {
+          tasks.clear();
+          head = 0;
+        }
+      return true;
+    }
+  };
+
+  void work(unsigned worker)
+  {
+    Task task;
+    while (true)
+      {
+        bool found = queues_[worker].pop_back(task);
+        for (unsigned k = 1 ; !found && k < size_ ; ++k)
+          found = queues_[(worker + k) % size_].pop_front(task);
+        if (!found)
+          return;
+
+        task.job->run(task.begin,task.end,worker);
+        pending_.fetch_sub(1,std::memory_order_release);
+      }
+  }
+
+  void worker_loop(unsigned worker)
+  {
+    unsigned long seen = 0;
+    while (true)
+      {
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          wakeup_.wait(lock,[this,seen]() {
+              return (stop_ || generation_ != seen);
+            });
+          if (stop_)
+            return;
+          seen = generation_;
+        }
+        work(worker);
+      }
+  }
+
+  const unsigned              size_;
+  std::unique_ptr<Queue[]>    queues_;
+  std::vector<std::thread>    workers_;
+  std::mutex                  mutex_;
+  std::condition_variable     wakeup_;
+  unsigned long               generation_;
+  bool                        stop_;
+  std::atomic<std::size_t>    pending_;
+};
+
+#endif // GTKMM_EXAMPLE_THREAD_POOL_H
@@ -0,0 +1,650 @@
+#ifndef GTKMM_EXAMPLE_TRAJECTORY_H
+#define GTKMM_EXAMPLE_TRAJECTORY_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "./particles.h"
+#include "./ring_buffer.h"
+
+/**
+   File format of a recorded trajectory: the positions of all balls
+   at every recorded step. The number of balls must stay the same
+   during the recording. The balls are stored in the order of their
+   ids (see Particles), so that reordering the balls during the
+   recording doesn't change the file.
+
+     Header
+     m, rad, color_r, color_g, color_b   (arrays of n doubles)
+     chunks
+     index                               (array of ChunkEntry)
+     Trailer
+
+   Positions are quantized to `bits` bits per coordinate over the
+   unit square (positions outside of it are clamped). Frames are
+   stored in chunks of keyframe_interval frames. The first frame of a
+   chunk holds the quantized coordinates themselves; each later frame
+   holds, per coordinate, the difference to the frame before. All
+   numbers are written as varints (7 bits per byte, lowest first),
+   the differences zigzag-encoded first, so that balls that move by a
+   few units per step take one byte per coordinate.
+
+   A frame starts with its step number, then the coordinates x0, y0,
+   x1, y1, .... Each chunk starts with a ChunkHeader. The index at the
+   end lists the chunks, so that a reader can jump to any frame and
+   decode at most keyframe_interval frames to get there. If the file
+   was not closed (e.g. the program crashed), there is no index, and
+   the reader finds the complete chunks by walking their headers.
+ */
+namespace trajectory_format {
+
+enum : std::uint32_t { version = 1, byte_order = 0x01020304 };
+enum Static : std::size_t { m, rad, color_r, color_g, color_b, statics };
+
+static const char magic[8]         = { 'S','I','M','U','L','T','R','J' };
+static const char trailer_magic[8] = { 'S','I','M','U','L','I','D','X' };
+
+struct Header
+{
+  char          magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint64_t balls;
+  std::uint32_t bits;
+  std::uint32_t keyframe_interval;
+  std::uint64_t data_offset;
+};
+
+struct ChunkHeader
+{
+  std::uint64_t first_frame;
+  std::uint32_t frames;
+  std::uint32_t bytes;
+};
+
+struct ChunkEntry
+{
+  std::uint64_t first_frame;
+  std::uint64_t offset;
+};
+
+struct Trailer
+{
+  std::uint64_t index_offset;
+  std::uint64_t chunks;
+  std::uint64_t frames;
+  char          magic[8];
+};
+
+inline void put_varint(std::vector<unsigned char> &out, std::uint64_t v)
+{
+  while (v >= 0x80)
+    {
+      out.push_back(static_cast<unsigned char>(v | 0x80));
+      v >>= 7;
+    }
+  out.push_back(static_cast<unsigned char>(v));
+}
+
+/* Reads a varint at p, which must be before end. Returns false on a
+   truncated or overlong varint. */
+inline bool get_varint(const unsigned char *&p, const unsigned char *end, std::uint64_t &v)
+{
+  v = 0;
+  for (unsigned shift = 0 ; shift < 64 && p != end ; shift += 7)
+    {
+      const unsigned char byte = *p++;
+      v |= std::uint64_t(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return true;
+    }
+  return false;
+}
+
+inline std::uint64_t zigzag(std::int64_t d)
+{ return (std::uint64_t(d) << 1) ^ std::uint64_t(d >> 63); }
+
+inline std::int64_t unzigzag(std::uint64_t z)
+{ return std::int64_t(z >> 1) ^ -std::int64_t(z & 1); }
+
+} // namespace trajectory_format
+
+/**
+   Records the positions of the balls at every step into a file (see
+   trajectory_format above).
+
+   record() quantizes the positions into a slot of a lock-free ring
+   buffer and returns; a background thread takes the frames from the
+   ring, encodes them and writes the file. If the writer falls
+   behind, record() waits for a free slot, so that no frame is lost;
+   stalls() counts how often that happened.
+ */
+class TrajectoryWriter
+{
+public:
+  TrajectoryWriter(const std::string &path,
+                   const Particles   &balls,
+                   unsigned           bits              = 16,
+                   unsigned           keyframe_interval = 64,
+                   std::size_t        ring_size         = 16)
+    : file_(std::fopen(path.c_str(),"wb")),
+      balls_(balls.size()),
+      bits_(std::min(std::max(bits,1u),31u)),
+      scale_(double((1u << bits_) - 1)),
+      keyframe_interval_(std::max(keyframe_interval,1u)),
+      ring_(ring_size),
+      closing_(false),
+      failed_(!file_),
+      stalls_(0),
+      rejected_(0),
+      frames_(0),
+      bytes_(0),
+      previous_(),
+      chunk_(),
+      chunk_first_(0),
+      chunk_frames_(0),
+      index_(),
+      offset_(0),
+      thread_()
+  {
+    if (failed_)
+      return;
+    write_header(balls);
+    thread_ = std::thread(&TrajectoryWriter::run,this);
+  }
+
+  TrajectoryWriter(const TrajectoryWriter &) = delete;
+  TrajectoryWriter &operator=(const TrajectoryWriter &) = delete;
+
+  ~TrajectoryWriter()
+  { close(); }
+
+  /**
+     Record the positions of the balls at the given step. The balls
+     must be those the writer was made for, with the same ids in any
+     order; a frame with a different number of balls or an id out of
+     range is not recorded, and false is returned, as when the file
+     has failed.
+   */
+  bool record(const Particles &balls, unsigned long step)
+  {
+    if (failed_ || closing_)
+      return false;
+    if (balls.size() != balls_)
+      {
+        ++rejected_;
+        return false;
+      }
+    for (const Particles::Cold &cold : balls.cold)
+      if (cold.id >= balls_)
+        {
+          ++rejected_;
+          return false;
+        }
+
+    Frame *frame;
+    while (!(frame = ring_.claim()))
+      {
+        ++stalls_;
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+
+    frame->step = step;
+    frame->q.resize(2 * balls_);
+    for (std::size_t i = 0 ; i < balls_ ; ++i)
+      {
+        const std::size_t id = balls.cold[i].id;
+        frame->q[2*id]   = quantize(balls.x[i]);
+        frame->q[2*id+1] = quantize(balls.y[i]);
+      }
+    ring_.push();
+    return true;
+  }
+
+  /**
+     Write the remaining frames and the index, and close the file.
+     Returns false if anything could not be written.
+   */
+  bool close()
+  {
+    if (thread_.joinable())
+      {
+        closing_ = true;
+        thread_.join();
+      }
+    if (file_)
+      {
+        finish();
+        failed_ = (std::fclose(file_) != 0) || failed_;
+        file_   = nullptr;
+      }
+    return !failed_;
+  }
+
+  bool good() const
+  { return !failed_; }
+
+  /**
+     Number of times record() had to wait for the writer.
+   */
+  unsigned long stalls() const
+  { return stalls_; }
+
+  /**
+     Number of frames that record() refused for their balls.
+   */
+  unsigned long rejected() const
+  { return rejected_; }
+
+  /**
+     Number of frames and of bytes of frame data written so far.
+   */
+  unsigned long frames() const
+  { return frames_; }
+
+  unsigned long bytes() const
+  { return bytes_; }
+
+private:
+  struct Frame
+  {
+    unsigned long              step = 0;
+    std::vector<std::uint32_t> q;
+  };
+
+  std::uint32_t quantize(double v) const
+  {
+    v = std::min(std::max(v,0.0),1.0);
+    return static_cast<std::uint32_t>(std::lround(v * scale_));
+  }
+
+  void write(const void *data, std::size_t size)
+  {
+    if (std::fwrite(data,1,size,file_) != size)
+      failed_ = true;
+  }
+
+  void write_header(const Particles &balls)
+  {
+    using namespace trajectory_format;
+
+    Header h;
+    std::memset(&h,0,sizeof(h));
+    std::memcpy(h.magic,magic,sizeof(magic));
+    h.version           = version;
+    h.byte_order        = byte_order;
+    h.balls             = balls_;
+    h.bits              = bits_;
+    h.keyframe_interval = keyframe_interval_;
+    h.data_offset       = sizeof(Header) + statics * balls_ * sizeof(double);
+    write(&h,sizeof(h));
+
+    std::vector<double> column(balls_);
+    for (std::size_t s = 0 ; s < statics ; ++s)
+      {
+        for (std::size_t i = 0 ; i < std::min(balls_,balls.size()) ; ++i)
+          {
+            const Particles::Cold &cold = balls.cold[i];
+            const double values[] = { balls.m[i], balls.rad[i],
+                                      cold.color_r, cold.color_g, cold.color_b };
+            if (cold.id < balls_)
+              column[cold.id] = values[s];
+          }
+        write(column.data(),balls_ * sizeof(double));
+      }
+    offset_ = h.data_offset;
+  }
+
+  void run()
+  {
+    while (true)
+      {
+        Frame *frame = ring_.front();
+        if (frame)
+          {
+            encode(*frame);
+            ring_.pop();
+          }
+        else if (closing_)
+          {
+            if (ring_.empty())
+              return;
+          }
+        else
+          std::this_thread::sleep_for(std::chrono::microseconds(200));
+      }
+  }
+
+  void encode(const Frame &frame)
+  {
+    using namespace trajectory_format;
+
+    if (chunk_frames_ == 0)
+      {
+        chunk_.clear();
+        chunk_first_ = frames_;
+        put_varint(chunk_,frame.step);
+        for (std::uint32_t q : frame.q)
+          put_varint(chunk_,q);
+      }
+    else
+      {
+        put_varint(chunk_,frame.step);
+        for (std::size_t k = 0 ; k < frame.q.size() ; ++k)
+          put_varint(chunk_,zigzag(std::int64_t(frame.q[k]) - std::int64_t(previous_[k])));
+      }
+    previous_ = frame.q;
+    ++frames_;
+    if (++chunk_frames_ == keyframe_interval_)
+      write_chunk();
+  }
+
+  void write_chunk()
+  {
+    using namespace trajectory_format;
+
+    if (chunk_frames_ == 0)
+      return;
+    const ChunkHeader h { chunk_first_, chunk_frames_, std::uint32_t(chunk_.size()) };
+    index_.push_back({ chunk_first_, offset_ });
+    write(&h,sizeof(h));
+    write(chunk_.data(),chunk_.size());
+    offset_       += sizeof(h) + chunk_.size();
+    bytes_        += chunk_.size();
+    chunk_frames_  = 0;
+  }
+
+  void finish()
+  {
+    using namespace trajectory_format;
+
+    write_chunk();
+    Trailer t;
+    t.index_offset = offset_;
+    t.chunks       = index_.size();
+    t.frames       = frames_;
+    std::memcpy(t.magic,trailer_magic,sizeof(trailer_magic));
+    write(index_.data(),index_.size() * sizeof(ChunkEntry));
+    write(&t,sizeof(t));
+  }
+
+  std::FILE                                 *file_;
+  std::size_t                                balls_;
+  unsigned                                   bits_;
+  double                                     scale_;
+  unsigned                                   keyframe_interval_;
+  RingBuffer<Frame>                          ring_;
+  std::atomic<bool>                          closing_;
+  std::atomic<bool>                          failed_;
+  std::atomic<unsigned long>                 stalls_;
+  unsigned long                              rejected_;
+  std::atomic<unsigned long>                 frames_;
+  std::atomic<unsigned long>                 bytes_;
+  std::vector<std::uint32_t>                 previous_;
+  std::vector<unsigned char>                 chunk_;
+  std::uint64_t                              chunk_first_;
+  std::uint32_t                              chunk_frames_;
+  std::vector<trajectory_format::ChunkEntry> index_;
+  std::uint64_t                              offset_;
+  std::thread                                thread_;
+};
+
+/**
+   Reads a trajectory file written by TrajectoryWriter. The file is
+   mapped into memory, and frames are decoded on demand: reading the
+   frame after the one read last costs one delta frame; any other
+   frame is found through the index and costs at most a chunk.
+ */
+class TrajectoryReader
+{
+public:
+  TrajectoryReader()
+    : map_(nullptr),
+      size_(0),
+      header_(),
+      statics_(nullptr),
+      index_(),
+      frames_(0),
+      current_(none),
+      cursor_(nullptr),
+      end_(nullptr),
+      step_(0),
+      q_()
+  { }
+
+  TrajectoryReader(const TrajectoryReader &) = delete;
+  TrajectoryReader &operator=(const TrajectoryReader &) = delete;
+
+  ~TrajectoryReader()
+  { close(); }
+
+  /**
+     Map the file at path. Returns false if it can't be read or isn't
+     a trajectory of this version.
+   */
+  bool open(const std::string &path)
+  {
+    using namespace trajectory_format;
+
+    close();
+    const int fd = ::open(path.c_str(),O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (::fstat(fd,&st) != 0 || std::uint64_t(st.st_size) < sizeof(Header))
+      {
+        ::close(fd);
+        return false;
+      }
+    size_ = st.st_size;
+    void *map = ::mmap(nullptr,size_,PROT_READ,MAP_PRIVATE,fd,0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+      return false;
+    map_ = static_cast<const unsigned char*>(map);
+
+    std::memcpy(&header_,map_,sizeof(header_));
+    const bool ok = (std::memcmp(header_.magic,magic,sizeof(magic)) == 0
+                     && header_.version == version && header_.byte_order == byte_order
+                     && header_.bits >= 1 && header_.bits <= 31
+                     && header_.keyframe_interval > 0
+                     && header_.data_offset == sizeof(Header) + statics * header_.balls * sizeof(double)
+                     && header_.data_offset <= size_);
+    if (!ok || !read_index())
+      {
+        close();
+        return false;
+      }
+    statics_ = reinterpret_cast<const double*>(map_ + sizeof(Header));
+    q_.resize(2 * header_.balls);
+    return true;
+  }
+
+  void close()
+  {
+    if (map_)
+      ::munmap(const_cast<unsigned char*>(map_),size_);
+    map_     = nullptr;
+    size_    = 0;
+    index_.clear();
+    frames_  = 0;
+    current_ = none;
+  }
+
+  bool is_open() const
+  { return map_ != nullptr; }
+
+  std::size_t balls() const
+  { return header_.balls; }
+
+  std::size_t frames() const
+  { return frames_; }
+
+  /**
+     Set balls to the positions of the given frame. The masses, radii
+     and colors are set too, the first time or if the number of balls
+     differs; the velocities are not recorded and are set to zero.
+     Returns false if there is no such frame, or it is damaged.
+   */
+  bool read(std::size_t frame, Particles &balls, unsigned long *step = nullptr)
+  {
+    using namespace trajectory_format;
+
+    const std::size_t n = header_.balls;
+    if (frame >= frames_)
+      return false;
+    if (!decode(frame))
+      {
+        current_ = none;
+        return false;
+      }
+
+    if (balls.size() != n)
+      {
+        balls = Particles();
+        balls.reserve(n);
+        for (std::size_t i = 0 ; i < n ; ++i)
+          {
+            Ball ball({0.0,0.0},{0.0,0.0},statics_[m*n+i],
+                      statics_[color_r*n+i],statics_[color_g*n+i],statics_[color_b*n+i]);
+            ball.rad = statics_[rad*n+i];
+            balls.push_back(ball);
+          }
+      }
+
+    const double scale = 1.0 / double((1u << header_.bits) - 1);
+    for (std::size_t i = 0 ; i < n ; ++i)
+      {
+        balls.x[i] = q_[2*i]   * scale;
+        balls.y[i] = q_[2*i+1] * scale;
+      }
+    if (step)
+      *step = step_;
+    return true;
+  }
+
+private:
+  enum : std::size_t { none = static_cast<std::size_t>(-1) };
+
+  /* Take the index from the trailer or, if there is none, find the
+     chunks by walking from one chunk header to the next. */
+  bool read_index()
+  {
+    using namespace trajectory_format;
+
+    Trailer t;
+    if (size_ >= header_.data_offset + sizeof(Trailer))
+      {
+        std::memcpy(&t,map_ + size_ - sizeof(Trailer),sizeof(t));
+        if (std::memcmp(t.magic,trailer_magic,sizeof(trailer_magic)) == 0
+            && t.index_offset <= size_ && t.chunks <= size_ / sizeof(ChunkEntry)
+            && t.index_offset + t.chunks * sizeof(ChunkEntry) + sizeof(Trailer) == size_)
+          {
+            index_.resize(t.chunks);
+            std::memcpy(index_.data(),map_ + t.index_offset,t.chunks * sizeof(ChunkEntry));
+            frames_ = t.frames;
+            return true;
+          }
+      }
+
+    std::uint64_t offset = header_.data_offset;
+    while (offset + sizeof(ChunkHeader) <= size_)
+      {
+        ChunkHeader h;
+        std::memcpy(&h,map_ + offset,sizeof(h));
+        if (h.first_frame != frames_ || h.frames == 0
+            || offset + sizeof(h) + h.bytes > size_)
+          break;
+        index_.push_back({ h.first_frame, offset });
+        frames_ += h.frames;
+        offset  += sizeof(h) + h.bytes;
+      }
+    return true;
+  }
+
+  /* Decode the given frame into q_, continuing from the current one
+     if it is the next in the same chunk. */
+  bool decode(std::size_t frame)
+  {
+    using namespace trajectory_format;
+
+    const std::size_t chunk = frame / header_.keyframe_interval;
+    if (chunk >= index_.size())
+      return false;
+
+    if (current_ == none || frame <= current_
+        || current_ / header_.keyframe_interval != chunk)
+      {
+        /* The index may be damaged, so the offsets are checked before
+           anything is read from them, in a way that can't overflow. */
+        ChunkHeader h;
+        const std::uint64_t offset = index_[chunk].offset;
+        if (offset > size_ || size_ - offset < sizeof(h))
+          return false;
+        std::memcpy(&h,map_ + offset,sizeof(h));
+        if (h.first_frame != chunk * header_.keyframe_interval
+            || h.bytes > size_ - offset - sizeof(h))
+          return false;
+        cursor_  = map_ + offset + sizeof(h);
+        end_     = cursor_ + h.bytes;
+        current_ = none;
+
+        /* The keyframe. */
+        std::uint64_t v;
+        if (!get_varint(cursor_,end_,v))
+          return false;
+        step_ = v;
+        for (auto &q : q_)
+          {
+            if (!get_varint(cursor_,end_,v))
+              return false;
+            q = std::uint32_t(v);
+          }
+        current_ = h.first_frame;
+      }
+
+    while (current_ < frame)
+      {
+        std::uint64_t v;
+        if (!get_varint(cursor_,end_,v))
+          return false;
+        step_ = v;
+        for (auto &q : q_)
+          {
+            if (!get_varint(cursor_,end_,v))
+              return false;
+            q = std::uint32_t(std::int64_t(q) + unzigzag(v));
+          }
+        ++current_;
+      }
+    return true;
+  }
+
+  const unsigned char                        *map_;
+  std::size_t                                 size_;
+  trajectory_format::Header                   header_;
+  const double                               *statics_;
+  std::vector<trajectory_format::ChunkEntry>  index_;
+  std::size_t                                 frames_;
+  std::size_t                                 current_;
+  const unsigned char                        *cursor_;
+  const unsigned char                        *end_;
+  unsigned long                               step_;
+  std::vector<std::uint32_t>                  q_;
+};
+
+#endif // GTKMM_EXAMPLE_TRAJECTORY_H
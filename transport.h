@@ -0,0 +1,272 @@
+#ifndef GTKMM_EXAMPLE_TRANSPORT_H
+#define GTKMM_EXAMPLE_TRANSPORT_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/**
+   Message passing between the processes of a distributed run (see
+   domain.h). The processes are numbered 0 to size() - 1, their
+   ranks; a message is a buffer of bytes, and the messages from one
+   rank to another arrive in the order they were sent.
+
+   The only primitive is exchange(), which sends one message and
+   receives one at the same time, so that two ranks may send to each
+   other without either waiting for the other to receive first. A
+   backend only has to implement that.
+ */
+class Transport
+{
+public:
+  enum : unsigned { none = static_cast<unsigned>(-1) };
+
+  virtual ~Transport()
+  { }
+
+  virtual unsigned rank() const = 0;
+
+  virtual unsigned size() const = 0;
+
+  /**
+     Send out to rank to, and receive the next message from rank
+     from into in, at the same time. Either rank may be none, to only
+     receive or only send. Returns false if a peer has gone away.
+   */
+  virtual bool exchange(unsigned to, const std::vector<char> &out,
+                        unsigned from, std::vector<char> &in) = 0;
+
+  bool send(unsigned to, const std::vector<char> &out)
+  {
+    std::vector<char> in;
+    return exchange(to,out,none,in);
+  }
+
+  bool receive(unsigned from, std::vector<char> &in)
+  {
+    static const std::vector<char> out;
+    return exchange(none,out,from,in);
+  }
+};
+
+/**
+   Transport between processes on one machine, over Unix-domain
+   sockets. spawn() forks the processes, with a pair of connected
+   sockets between each two of them; each message goes as its size
+   (64 bits) followed by its bytes.
+
+   The sockets don't block: exchange() polls both of its sockets and
+   writes and reads whatever fits, so that a large message in each
+   direction can't fill both socket buffers and stall.
+ */
+class SocketTransport final : public Transport
+{
+public:
+  /**
+     Fork ranks - 1 child processes, which continue from the call as
+     ranks 1 to ranks - 1, while the caller becomes rank 0. Returns
+     nullptr if the sockets or processes can't be made. This should be
+     called before any threads are started.
+   */
+  static std::unique_ptr<SocketTransport> spawn(unsigned ranks)
+  {
+    /* sockets[a * ranks + b] is the end of a for the pair a, b. */
+    std::vector<int> sockets(ranks * ranks,-1);
+    for (unsigned a = 0 ; a < ranks ; ++a)
+      for (unsigned b = a + 1 ; b < ranks ; ++b)
+        {
+          int pair[2];
+          if (::socketpair(AF_UNIX,SOCK_STREAM,0,pair) != 0)
+            {
+              for (int fd : sockets)
+                if (fd >= 0)
+                  ::close(fd);
+              return nullptr;
+            }
+          sockets[a * ranks + b] = pair[0];
+          sockets[b * ranks + a] = pair[1];
+        }
+
+    std::vector<pid_t> children;
+    unsigned rank = 0;
+    for (unsigned r = 1 ; r < ranks ; ++r)
+      {
+        const pid_t pid = ::fork();
+        if (pid < 0)
+          {
+            /* The children started so far find their sockets closed
+               and give up. */
+            for (int fd : sockets)
+              if (fd >= 0)
+                ::close(fd);
+            for (pid_t child : children)
+              ::waitpid(child,nullptr,0);
+            return nullptr;
+          }
+        if (pid == 0)
+          {
+            rank = r;
+            children.clear();
+            break;
+          }
+        children.push_back(pid);
+      }
+
+    std::unique_ptr<SocketTransport> transport(new SocketTransport(rank,ranks));
+    transport->children_ = std::move(children);
+    for (unsigned a = 0 ; a < ranks ; ++a)
+      for (unsigned b = 0 ; b < ranks ; ++b)
+        {
+          const int fd = sockets[a * ranks + b];
+          if (fd < 0)
+            continue;
+          if (a == rank)
+            {
+              ::fcntl(fd,F_SETFL,::fcntl(fd,F_GETFL) | O_NONBLOCK);
+              transport->peers_[b] = fd;
+            }
+          else
+            ::close(fd);
+        }
+    return transport;
+  }
+
+  SocketTransport(const SocketTransport &) = delete;
+  SocketTransport &operator=(const SocketTransport &) = delete;
+
+  ~SocketTransport()
+  {
+    close();
+    join();
+  }
+
+  unsigned rank() const override
+  { return rank_; }
+
+  unsigned size() const override
+  { return size_; }
+
+  bool exchange(unsigned to, const std::vector<char> &out,
+                unsigned from, std::vector<char> &in) override
+  {
+    const std::uint64_t out_size = out.size();
+    std::uint64_t       in_size  = 0;
+    const std::size_t   head     = sizeof(std::uint64_t);
+
+    std::size_t sent     = 0;
+    std::size_t received = 0;
+    std::size_t to_send  = (to == none ? 0 : head + out.size());
+    std::size_t to_read  = (from == none ? 0 : head);
+    if ((to != none && peers_[to] < 0) || (from != none && peers_[from] < 0))
+      return false;
+
+    while (sent < to_send || received < to_read)
+      {
+        pollfd fds[2];
+        nfds_t n = 0;
+        if (sent < to_send)
+          fds[n++] = { peers_[to], POLLOUT, 0 };
+        if (received < to_read)
+          fds[n++] = { peers_[from], POLLIN, 0 };
+        if (::poll(fds,n,-1) < 0)
+          {
+            if (errno == EINTR)
+              continue;
+            return false;
+          }
+
+        for (nfds_t k = 0 ; k < n ; ++k)
+          {
+            if (fds[k].revents == 0)
+              continue;
+            if (fds[k].events == POLLOUT)
+              {
+                const char *data = (sent < head
+                                    ? reinterpret_cast<const char*>(&out_size) + sent
+                                    : out.data() + (sent - head));
+                const std::size_t size = (sent < head ? head - sent : to_send - sent);
+                const ssize_t done = ::send(fds[k].fd,data,size,MSG_NOSIGNAL);
+                if (done < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                  return false;
+                if (done > 0)
+                  sent += done;
+              }
+            else
+              {
+                char *data = (received < head
+                              ? reinterpret_cast<char*>(&in_size) + received
+                              : in.data() + (received - head));
+                const std::size_t size = (received < head ? head - received : to_read - received);
+                const ssize_t done = ::recv(fds[k].fd,data,size,0);
+                if (done == 0)
+                  return false;
+                if (done < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                  return false;
+                if (done > 0)
+                  {
+                    received += done;
+                    if (received == head)
+                      {
+                        in.resize(in_size);
+                        to_read = head + in_size;
+                      }
+                  }
+              }
+          }
+      }
+    return true;
+  }
+
+  /**
+     Close the sockets, and in rank 0 wait for the other processes to
+     end. Returns false if any of them failed.
+   */
+  bool join()
+  {
+    close();
+    bool ok = true;
+    for (pid_t child : children_)
+      {
+        int status = 0;
+        if (::waitpid(child,&status,0) != child || !WIFEXITED(status)
+            || WEXITSTATUS(status) != 0)
+          ok = false;
+      }
+    children_.clear();
+    return ok;
+  }
+
+private:
+  SocketTransport(unsigned rank, unsigned size)
+    : rank_(rank),
+      size_(size),
+      peers_(size,-1),
+      children_()
+  { }
+
+  void close()
+  {
+    for (int &fd : peers_)
+      if (fd >= 0)
+        {
+          ::close(fd);
+          fd = -1;
+        }
+  }
+
+  unsigned           rank_;
+  unsigned           size_;
+  std::vector<int>   peers_;
+  std::vector<pid_t> children_;
+};
+
+#endif // GTKMM_EXAMPLE_TRANSPORT_H
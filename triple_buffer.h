@@ -0,0 +1,75 @@
+#ifndef GTKMM_EXAMPLE_TRIPLE_BUFFER_H
+#define GTKMM_EXAMPLE_TRIPLE_BUFFER_H
+
+#include <atomic>
+
+/**
+   Lock-free triple buffer, for handing a stream of values from one
+   producer thread to one consumer thread.
+
+   The producer fills back(), then calls publish(). The consumer calls
+   acquire() and reads the returned value. Neither side ever waits for
+   the other: the producer always has a slot to write to, and the
+   consumer always gets the newest value published so far (or the
+   same one again, if nothing new was published).
+
+   The three slots are reused, so a T that keeps its capacity on
+   assignment (such as std::vector) doesn't allocate once it has
+   grown to its final size.
+ */
+template <class T>
+class TripleBuffer
+{
+public:
+  TripleBuffer()
+    : slots_(),
+      back_(0),
+      middle_(1),
+      front_(2)
+  { }
+
+  TripleBuffer(const TripleBuffer &) = delete;
+  TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+  /**
+     The slot the producer writes to.
+   */
+  T &back()
+  { return slots_[back_]; }
+
+  /**
+     Make back() visible to the consumer and take another slot to
+     write to.
+   */
+  void publish()
+  {
+    back_ = middle_.exchange(back_ | fresh,std::memory_order_acq_rel) & index;
+  }
+
+  /**
+     The newest published value. It stays valid, and unchanged, until
+     the next call of acquire().
+   */
+  const T &acquire()
+  {
+    if (middle_.load(std::memory_order_relaxed) & fresh)
+      front_ = middle_.exchange(front_,std::memory_order_acq_rel) & index;
+    return slots_[front_];
+  }
+
+  /**
+     Whether acquire() would return a value not seen before.
+   */
+  bool has_fresh() const
+  { return (middle_.load(std::memory_order_relaxed) & fresh) != 0; }
+
+private:
+  enum : unsigned { index = 3, fresh = 4 };
+
+  T                     slots_[3];
+  unsigned              back_;
+  std::atomic<unsigned> middle_;
+  unsigned              front_;
+};
+
+#endif // GTKMM_EXAMPLE_TRIPLE_BUFFER_H
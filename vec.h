@@ -0,0 +1,116 @@
+#ifndef GTKMM_EXAMPLE_VEC_H
+#define GTKMM_EXAMPLE_VEC_H
+
+#include <cmath>
+#include <cstddef>
+
+template <class T>
+constexpr T sqr(const T v)
+{ return v * v; }
+
+/**
+   A vector of N components of type T, for N = 2 or 3.
+
+   Vec is an aggregate, so Vec<double,2> { x, y } initializes it and
+   Vec<double,2> {} is the zero vector; all operations are constexpr.
+   The components are named x, y (and z), and are also reached by
+   index with v[k], so that the operations below are written once for
+   all N.
+
+   The physics uses Vec2d; the number type of the stored balls and of
+   the kernels is chosen by the policy in policy.h.
+ */
+template <class T, std::size_t N>
+struct Vec;
+
+template <class T>
+struct Vec<T,2>
+{
+  T x;
+  T y;
+
+  constexpr T &operator[](std::size_t k)
+  { return (k == 0 ? x : y); }
+
+  constexpr const T &operator[](std::size_t k) const
+  { return (k == 0 ? x : y); }
+};
+
+template <class T>
+struct Vec<T,3>
+{
+  T x;
+  T y;
+  T z;
+
+  constexpr T &operator[](std::size_t k)
+  { return (k == 0 ? x : k == 1 ? y : z); }
+
+  constexpr const T &operator[](std::size_t k) const
+  { return (k == 0 ? x : k == 1 ? y : z); }
+};
+
+using Vec2d = Vec<double,2>;
+using Vec3d = Vec<double,3>;
+using Vec2f = Vec<float,2>;
+using Vec3f = Vec<float,3>;
+
+template <class T, std::size_t N>
+constexpr Vec<T,N> &operator+=(Vec<T,N> &v1, const Vec<T,N> &v2)
+{
+  for (std::size_t k = 0 ; k < N ; ++k)
+    v1[k] += v2[k];
+  return v1;
+}
+
+template <class T, std::size_t N>
+constexpr Vec<T,N> &operator-=(Vec<T,N> &v1, const Vec<T,N> &v2)
+{
+  for (std::size_t k = 0 ; k < N ; ++k)
+    v1[k] -= v2[k];
+  return v1;
+}
+
+template <class T, std::size_t N>
+constexpr Vec<T,N> operator+(Vec<T,N> v1, const Vec<T,N> &v2)
+{ return v1 += v2; }
+
+template <class T, std::size_t N>
+constexpr Vec<T,N> operator-(Vec<T,N> v1, const Vec<T,N> &v2)
+{ return v1 -= v2; }
+
+template <class T, std::size_t N>
+constexpr Vec<T,N> operator*(T scalar, Vec<T,N> v)
+{
+  for (std::size_t k = 0 ; k < N ; ++k)
+    v[k] *= scalar;
+  return v;
+}
+
+template <class T, std::size_t N>
+constexpr T dot(const Vec<T,N> &v1, const Vec<T,N> &v2)
+{
+  T result = v1[0] * v2[0];
+  for (std::size_t k = 1 ; k < N ; ++k)
+    result += v1[k] * v2[k];
+  return result;
+}
+
+template <class T, std::size_t N>
+constexpr T norm(const Vec<T,N> &v)
+{ return dot(v,v); }
+
+template <class T, std::size_t N>
+T len(const Vec<T,N> &v)
+{ return std::sqrt(norm(v)); }
+
+template <class T, std::size_t N>
+Vec<T,N> normal(Vec<T,N> v)
+{
+  const T L = len(v);
+  for (std::size_t k = 0 ; k < N ; ++k)
+    v[k] /= L;
+  return v;
+}
+
+#endif // GTKMM_EXAMPLE_VEC_H